@@ -12,6 +12,10 @@
 # limitations under the License.
 
 
+# Included by the application and by terminal components using myriotamath,
+# so only the first include counts
+ifndef MATH_BUILD_DIR
+
 allsourceindirs = $(foreach dir,$(1), $(foreach ext, $(2), $(wildcard $(dir)/*.$(ext))))
 
 # default extentions
@@ -49,3 +53,5 @@ $(MATH_BUILD_DIR)%.$(CEXT).mathlib.o : %.$(CEXT)
 $(MATH_BUILD_DIR)%.$(CPPEXT).mathlib.o : %.$(CPPEXT)
 	mkdir -p $(dir $@)
 	$(CXX) $(CXXFLAGS) -MMD -c $< -o $@
+
+endif
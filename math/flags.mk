@@ -14,6 +14,6 @@
 
 CC ?= gcc
 CXX ?= g++
-CFLAGS += -Wall -Werror $(APPEND_FLAGS) -I$(ROOTDIR) -std=c99
-CXXFLAGS += -Wall -Werror $(APPEND_FLAGS) -I$(ROOTDIR) -std=c++11
-LDFLAGS += -lm
+CFLAGS += -Wall -Werror -O2 -pthread $(APPEND_FLAGS) -I$(ROOTDIR) -std=c99
+CXXFLAGS += -Wall -Werror -O2 -pthread $(APPEND_FLAGS) -I$(ROOTDIR) -std=c++11
+LDFLAGS += -lm -pthread
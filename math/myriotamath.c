@@ -11,8 +11,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#if defined(__unix__)
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS
+#endif
 #include "math/myriotamath.h"
 #include <stdio.h>
+#if defined(__unix__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 double myriota_modulus(const double arg1, const double arg2) {
   const int i = arg1 / arg2;
@@ -107,16 +117,171 @@ void myriota_set_bit(const unsigned int n, const unsigned int value,
   if (value != 0) x[d] |= (1 << r);
 }
 
+// Big endian 64 bit word at p regardless of alignment or byte order
+static inline uint64_t load_be64(const uint8_t *p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return __builtin_bswap64(w);
+#else
+  uint64_t w = 0;
+  for (int i = 0; i < 8; i++) w = (w << 8) | p[i];
+  return w;
+#endif
+}
+
+static inline uint64_t reverse_bytes64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_bswap64(x);
+#else
+  uint64_t r = 0;
+  for (int i = 0; i < 8; i++, x >>= 8) r = (r << 8) | (x & 0xff);
+  return r;
+#endif
+}
+
+// The 1 to 64 bits of data starting at bit position, bits past size bytes
+// being zero. Loads the 8 bytes containing the first bit and, when the field
+// straddles them, one more.
+static inline uint64_t get_bits(const uint8_t *data, const size_t size,
+                                const size_t position,
+                                const unsigned int bits) {
+  const size_t byte = position / 8;
+  const unsigned int shift = position % 8;
+  uint64_t w = 0;
+  if (byte + 8 <= size) {
+    w = load_be64(data + byte);
+  } else {
+    for (size_t i = byte; i < byte + 8; i++)
+      w = (w << 8) | (i < size ? data[i] : 0);
+  }
+  w <<= shift;
+  if (shift + bits > 64 && byte + 8 < size) w |= data[byte + 8] >> (8 - shift);
+  return w >> (64 - bits);
+}
+
+void myriota_bit_writer_init(myriota_bit_writer *w, void *data, size_t start) {
+  w->data = (uint8_t *)data;
+  w->byte = start / 8;
+  w->pending = start % 8;
+  w->accumulator = w->pending ? w->data[w->byte] >> (8 - w->pending) : 0;
+}
+
+// Write out the whole bytes in the accumulator
+static inline void bit_writer_drain(myriota_bit_writer *w) {
+  while (w->pending >= 8) {
+    w->pending -= 8;
+    w->data[w->byte++] = w->accumulator >> w->pending;
+  }
+}
+
+void myriota_bit_writer_write(myriota_bit_writer *w, uint64_t value,
+                              unsigned int bits) {
+  if (bits > 32) {
+    myriota_bit_writer_write(w, value >> 32, bits - 32);
+    bits = 32;
+  }
+  if (bits == 0) return;
+  value &= (UINT64_C(1) << bits) - 1;
+  // fewer than 8 bits pending after draining, so 32 more always fit
+  if (w->pending + bits > 64) bit_writer_drain(w);
+  w->accumulator = (w->accumulator << bits) | value;
+  w->pending += bits;
+}
+
+void myriota_bit_writer_flush(myriota_bit_writer *w) {
+  bit_writer_drain(w);
+  if (w->pending > 0) {
+    const unsigned int r = 8 - w->pending;
+    const uint8_t mask = 0xff << r;
+    uint8_t *b = w->data + w->byte;
+    *b = (*b & ~mask) | ((w->accumulator << r) & mask);
+  }
+}
+
+void myriota_bit_reader_init(myriota_bit_reader *r, const void *data,
+                             size_t size, size_t start) {
+  r->data = (const uint8_t *)data;
+  r->size = size;
+  r->position = start;
+}
+
+uint64_t myriota_bit_reader_read(myriota_bit_reader *r, unsigned int bits) {
+  if (bits == 0) return 0;
+  if (bits > 64) bits = 64;
+  const uint64_t v = get_bits(r->data, r->size, r->position, bits);
+  r->position += bits;
+  return v;
+}
+
 void myriota_write_bits(const uint8_t *from, uint8_t *to,
                         const unsigned int start, const unsigned int stop) {
-  for (int n = start; n <= stop; n++)
-    myriota_set_bit(n, myriota_get_bit(n - start, from), to);
+  if (stop < start) return;
+  const size_t n = (size_t)stop - start + 1;
+  myriota_bit_writer w;
+  myriota_bit_writer_init(&w, to, start);
+  for (size_t i = 0; i < n; i += 32) {
+    const unsigned int bits = n - i < 32 ? n - i : 32;
+    myriota_bit_writer_write(&w, get_bits(from, (n + 7) / 8, i, bits), bits);
+  }
+  myriota_bit_writer_flush(&w);
 }
 
 void myriota_read_bits(const uint8_t *from, uint8_t *to,
                        const unsigned int start, const unsigned int stop) {
-  for (int n = start; n <= stop; n++)
-    myriota_set_bit(n - start, myriota_get_bit(n, from), to);
+  if (stop < start) return;
+  const size_t n = (size_t)stop - start + 1;
+  myriota_bit_writer w;
+  myriota_bit_writer_init(&w, to, 0);
+  for (size_t i = 0; i < n; i += 32) {
+    const unsigned int bits = n - i < 32 ? n - i : 32;
+    myriota_bit_writer_write(&w, get_bits(from, stop / 8 + 1, start + i, bits),
+                             bits);
+  }
+  myriota_bit_writer_flush(&w);
+}
+
+int myriota_unpack_bit_fields(const void *messages, size_t message_size,
+                              size_t count, const myriota_bit_field *fields,
+                              size_t n_fields) {
+  for (size_t f = 0; f < n_fields; f++) {
+    const myriota_bit_field *field = fields + f;
+    if (field->bits == 0 || field->bits > 64) return -1;
+    if (field->offset + field->bits > 8 * message_size) return -1;
+    if (field->little_endian && field->bits % 8 != 0) return -1;
+    const unsigned int c = field->column_size;
+    if (c != 1 && c != 2 && c != 4 && c != 8) return -1;
+  }
+  const uint8_t *data = (const uint8_t *)messages;
+  const size_t size = message_size * count;
+  // Column at a time so the inner loop has a fixed field layout and writes
+  // one column sequentially
+  for (size_t f = 0; f < n_fields; f++) {
+    const myriota_bit_field *field = fields + f;
+    const unsigned int bits = field->bits;
+    const uint64_t sign = field->is_signed ? UINT64_C(1) << (bits - 1) : 0;
+    size_t position = field->offset;
+    for (size_t m = 0; m < count; m++, position += 8 * message_size) {
+      uint64_t v = get_bits(data, size, position, bits);
+      if (field->little_endian) v = reverse_bytes64(v) >> (64 - bits);
+      v = (v ^ sign) - sign;  // sign extend
+      switch (field->column_size) {
+        case 1:
+          ((uint8_t *)field->column)[m] = v;
+          break;
+        case 2:
+          ((uint16_t *)field->column)[m] = v;
+          break;
+        case 4:
+          ((uint32_t *)field->column)[m] = v;
+          break;
+        default:
+          ((uint64_t *)field->column)[m] = v;
+      }
+    }
+  }
+  return 0;
 }
 
 myriota_complex myriota_polar(myriota_decimal magnitude,
@@ -158,47 +323,59 @@ double myriota_besselI(int n, double x) {
   return sum;
 }
 
+// Character codecs work a whole group at a time, 1 byte to 2 hexidecimal
+// digits, 3 bytes to 4 base64 digits and 5 bytes to 8 zbase32 digits, with
+// digit values looked up in tables indexed by ASCII code. Characters outside
+// ASCII are never valid.
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static const int8_t hex_value[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x00
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x10
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x20
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,  // 0x30
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x40
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x50
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x60
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x70
+};
+
+// Value of hexidecimal digit h, or -1 if h is not hexidecimal
+static inline int hex_digit(const char h) {
+  const uint8_t c = h;
+  return c < 128 ? hex_value[c] : -1;
+}
+
 // Convert hexidecimal character to number in the interval [0,15]
 // Returns 1 (the number of characters scanned) on success and 0 if the
 // character is not hexidecimal
 int myriota_hex_character_to_number(const char h, int *n) {
-  if (h >= '0' && h <= '9') {
-    *n = h - '0';
-    return 1;
-  }
-  if (h >= 'A' && h <= 'F') {
-    *n = h - 'A' + 10;
-    return 1;
-  }
-  if (h >= 'a' && h <= 'f') {
-    *n = h - 'a' + 10;
-    return 1;
-  }
-  return 0;
+  const int v = hex_digit(h);
+  if (v < 0) return 0;
+  *n = v;
+  return 1;
 }
 
 bool myriota_is_hex(const char *s) {
-  int n;
-  for (int i = 0; i < strlen(s); i++)
-    if (myriota_hex_character_to_number(s[i], &n) == 0) return false;
+  for (; *s != '\0'; s++)
+    if (hex_digit(*s) < 0) return false;
   return true;
 }
 
 int myriota_hex_to_byte(const char *h, uint8_t *b) {
-  int h0;
-  if (myriota_hex_character_to_number(h[0], &h0) != 1) return 0;
-  int h1;
-  if (myriota_hex_character_to_number(h[1], &h1) != 1) return 0;
-  *b = 0;
-  *b = *b | h1;
-  *b = *b | (h0 << 4);
+  const int h0 = hex_digit(h[0]);
+  if (h0 < 0) return 0;
+  const int h1 = hex_digit(h[1]);
+  if (h1 < 0) return 0;
+  *b = (h0 << 4) | h1;
   return 2;
 }
 
 int myriota_n_hex_to_buf(const char *s, const size_t n, void *buf) {
   uint8_t *bytes = (uint8_t *)buf;
-  const size_t slen = strlen(s);
-  const size_t m = n > slen ? slen : n;
+  size_t m = 0;  // smaller of n and strlen(s)
+  while (m < n && s[m] != '\0') m++;
   if (m % 2 != 0) return 0;  // n must be even
   for (const char *c = s; c < s + m; c += 2, bytes++)
     if (myriota_hex_to_byte(c, bytes) != 2) return 0;  // scan failed
@@ -211,7 +388,11 @@ int myriota_hex_to_buf(const char *s, void *buf) {
 
 int myriota_buf_to_hex(const void *buf, const size_t buf_size, char *s) {
   const uint8_t *bytes = (const uint8_t *)buf;
-  for (size_t i = 0; i < buf_size; i++) s += sprintf(s, "%02x", bytes[i]);
+  for (size_t i = 0; i < buf_size; i++) {
+    s[2 * i] = hex_digits[bytes[i] >> 4];
+    s[2 * i + 1] = hex_digits[bytes[i] & 0xf];
+  }
+  if (buf_size > 0) s[2 * buf_size] = '\0';
   return buf_size * 2;
 }
 
@@ -220,32 +401,42 @@ void myriota_print_hex(const void *buf, int length) {
   for (int i = 0; i < length; i++) printf("%02x", b[i]);
 }
 
+static const char base64_digits[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ+/";
+
+static const int8_t base64_value[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x00
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x10
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,  // 0x20
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,  // 0x30
+    -1, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50,  // 0x40
+    51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1,  // 0x50
+    -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,  // 0x60
+    25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, -1, -1, -1, -1, -1,  // 0x70
+};
+
+static inline int base64_digit(const char b) {
+  const uint8_t c = b;
+  return c < 128 ? base64_value[c] : -1;
+}
+
 // converts integer in the range 0 - 63 to a base64 character.
 // Return -1 if n is out of range
 char myriota_number_to_base64(int n) {
-  if (n < 0) return -1;
-  if (n < 10) return n + '0';
-  if (n < 10 + 26) return n - 10 + 'a';
-  if (n < 10 + 26 + 26) return n - 10 - 26 + 'A';
-  if (n == 62) return '+';
-  if (n == 63) return '/';
+  if (n >= 0 && n < 64) return base64_digits[n];
   return -1;
 }
 
 // convert base64 char to number
 // Return -1 if character not valid base64
-int myriota_base64_to_number(char b) {
-  if (b >= '0' && b <= '9') return b - '0';
-  if (b >= 'a' && b <= 'z') return 10 + b - 'a';
-  if (b >= 'A' && b <= 'Z') return 10 + 26 + b - 'A';
-  if (b == '+') return 62;
-  if (b == '/') return 63;
-  return -1;
-}
-
-int myriota_n_base64_to_buf(const char *s, const size_t n, void *buf) {
-  if (n % 4 != 0) return -1;  // only multiples of 4 supported
-  for (unsigned int i = 0; i < n * 6; i++) {
+int myriota_base64_to_number(char b) { return base64_digit(b); }
+
+// Decodes characters first to n of s one bit at a time, stopping at the first
+// invalid character. Used after the last whole valid group so that the bits
+// written before an error are exactly those written by a bitwise decoder.
+static int base64_bits_to_buf(const char *s, const size_t first,
+                              const size_t n, void *buf) {
+  for (unsigned int i = first * 6; i < n * 6; i++) {
     const int b = myriota_base64_to_number(s[i / 6]);
     if (b < 0) return -1;
     const uint8_t c = b;
@@ -255,22 +446,37 @@ int myriota_n_base64_to_buf(const char *s, const size_t n, void *buf) {
   return n;
 }
 
+int myriota_n_base64_to_buf(const char *s, const size_t n, void *buf) {
+  if (n % 4 != 0) return -1;  // only multiples of 4 supported
+  uint8_t *b = (uint8_t *)buf;
+  size_t i = myriota_base64_decode_blocks(s, n, b);
+  for (; i < n; i += 4) {
+    const int v0 = base64_digit(s[i]), v1 = base64_digit(s[i + 1]);
+    const int v2 = base64_digit(s[i + 2]), v3 = base64_digit(s[i + 3]);
+    if ((v0 | v1 | v2 | v3) < 0) break;
+    const uint32_t w = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+    uint8_t *o = b + i / 4 * 3;
+    o[0] = w >> 16;
+    o[1] = w >> 8;
+    o[2] = w;
+  }
+  return base64_bits_to_buf(s, i, n, buf);
+}
+
 int myriota_base64_to_buf(const char *s, void *buf) {
   return myriota_n_base64_to_buf(s, strlen(s), buf);
 }
 
 int myriota_buf_to_base64(const void *buf, const size_t buf_size, char *s) {
   if (buf_size % 3 != 0) return -1;  // only multiples of 3 supported
-  uint8_t n = 0;
+  const uint8_t *b = (const uint8_t *)buf;
   int count = 0;
-  for (unsigned int i = 0; i < buf_size * 8; i++) {
-    const int bit = myriota_get_bit(i, buf);
-    myriota_set_bit((i % 6) + 2, bit, &n);
-    if ((i % 6) == 5) {
-      s[count] = myriota_number_to_base64(n);
-      count++;
-      n = 0;
-    }
+  for (size_t i = 0; i < buf_size; i += 3) {
+    const uint32_t w = (b[i] << 16) | (b[i + 1] << 8) | b[i + 2];
+    s[count++] = base64_digits[w >> 18];
+    s[count++] = base64_digits[(w >> 12) & 0x3f];
+    s[count++] = base64_digits[(w >> 6) & 0x3f];
+    s[count++] = base64_digits[w & 0x3f];
   }
   s[count] = '\0';
   return count;
@@ -278,6 +484,22 @@ int myriota_buf_to_base64(const void *buf, const size_t buf_size, char *s) {
 
 static const char *zbase32 = "ybndrfg8ejkmcpqxot1uwisza345h769";
 
+static const int8_t zbase32_value[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x00
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x10
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x20
+    -1, 18, -1, 25, 26, 27, 30, 29,  7, 31, -1, -1, -1, -1, -1, -1,  // 0x30
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x40
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x50
+    -1, 24,  1, 12,  3,  8,  5,  6, 28, 21,  9, 10, -1, 11,  2, 16,  // 0x60
+    13, 14,  4, 22, 17, 19, -1, 20, 15,  0, 23, -1, -1, -1, -1, -1,  // 0x70
+};
+
+static inline int zbase32_digit(const char b) {
+  const uint8_t c = b;
+  return c < 128 ? zbase32_value[c] : -1;
+}
+
 // converts integer in the range 0 - 31 to a base32 character.
 // Return -1 if n is out of range
 char myriota_number_to_zbase32(int n) {
@@ -287,31 +509,28 @@ char myriota_number_to_zbase32(int n) {
 
 // convert base32 char to number
 // Return -1 if character not valid base32
-int myriota_zbase32_to_number(char b) {
-  for (int i = 0; i < 32; i++)
-    if (zbase32[i] == b) return i;
-  return -1;
-}
+int myriota_zbase32_to_number(char b) { return zbase32_digit(b); }
 
 int myriota_buf_to_zbase32(const void *buf, const size_t buf_size, char *s) {
   if (buf_size % 5 != 0) return -1;  // only multiples of 5 supported
-  uint8_t n = 0;
+  const uint8_t *b = (const uint8_t *)buf;
   int count = 0;
-  for (unsigned int i = 0; i < buf_size * 8; i++) {
-    const int bit = myriota_get_bit(i, buf);
-    myriota_set_bit((i % 5) + 3, bit, &n);
-    if ((i % 5) == 4) {
-      s[count] = myriota_number_to_zbase32(n);
-      count++;
-      n = 0;
-    }
+  for (size_t i = 0; i < buf_size; i += 5) {
+    const uint64_t w = ((uint64_t)b[i] << 32) | ((uint32_t)b[i + 1] << 24) |
+                       (b[i + 2] << 16) | (b[i + 3] << 8) | b[i + 4];
+    for (int shift = 35; shift >= 0; shift -= 5)
+      s[count++] = zbase32[(w >> shift) & 0x1f];
   }
   s[count] = '\0';
   return count;
 }
 
-int myriota_n_zbase32_to_buf(const char *s, const size_t n, void *buf) {
-  for (unsigned int i = 0; i < n * 5; i++) {
+// Decodes characters first to n of s one bit at a time, stopping at the first
+// invalid character. Handles the final partial group, where the bits of the
+// last byte past the end of the string are left untouched, and errors.
+static int zbase32_bits_to_buf(const char *s, const size_t first,
+                               const size_t n, void *buf) {
+  for (unsigned int i = first * 5; i < n * 5; i++) {
     const int b = myriota_zbase32_to_number(s[i / 5]);
     if (b < 0) return -1;
     const uint8_t c = b;
@@ -321,33 +540,30 @@ int myriota_n_zbase32_to_buf(const char *s, const size_t n, void *buf) {
   return n;
 }
 
-int myriota_zbase32_to_buf(const char *s, void *buf) {
-  return myriota_n_zbase32_to_buf(s, strlen(s), buf);
-}
-
-// Reverses bits in a 32-bit word.
-static uint32_t reverse_bits(uint32_t x) {
-  x = ((x & 0x55555555) << 1) | ((x >> 1) & 0x55555555);
-  x = ((x & 0x33333333) << 2) | ((x >> 2) & 0x33333333);
-  x = ((x & 0x0F0F0F0F) << 4) | ((x >> 4) & 0x0F0F0F0F);
-  x = (x << 24) | ((x & 0xFF00) << 8) | ((x >> 8) & 0xFF00) | (x >> 24);
-  return x;
-}
-
-uint32_t myriota_crc32(const void *data, size_t length, uint32_t offset) {
-  uint32_t crc = ~offset;
-  const uint8_t *bytes = (uint8_t *)data;
-  for (int i = 0; i < length; i++) {
-    uint32_t b = reverse_bits(bytes[i]);
+int myriota_n_zbase32_to_buf(const char *s, const size_t n, void *buf) {
+  uint8_t *b = (uint8_t *)buf;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w = 0;
+    int invalid = 0;
     for (int j = 0; j < 8; j++) {
-      if ((int32_t)(crc ^ b) < 0)
-        crc = (crc << 1) ^ 0x04C11DB7;
-      else
-        crc = crc << 1;
-      b = b << 1;
+      const int v = zbase32_digit(s[i + j]);
+      invalid |= v;
+      w = (w << 5) | (v & 0x1f);
     }
+    if (invalid < 0) break;
+    uint8_t *o = b + i / 8 * 5;
+    o[0] = w >> 32;
+    o[1] = w >> 24;
+    o[2] = w >> 16;
+    o[3] = w >> 8;
+    o[4] = w;
   }
-  return reverse_bits(~crc);
+  return zbase32_bits_to_buf(s, i, n, buf);
+}
+
+int myriota_zbase32_to_buf(const char *s, void *buf) {
+  return myriota_n_zbase32_to_buf(s, strlen(s), buf);
 }
 
 int myriota_random_bernoulli(double p) {
@@ -494,6 +710,13 @@ double myriota_unwrap(const double value, const double previous_value) {
     return d + previous_value;
 }
 
+#define swap(type, a, b) \
+  {                      \
+    const type t = a;    \
+    a = b;               \
+    b = t;               \
+  }
+
 static int cmp_double(const void *ap, const void *bp) {
   double a = *(double *)ap;
   double b = *(double *)bp;
@@ -505,26 +728,112 @@ static int cmp_double(const void *ap, const void *bp) {
     return 0;
 }
 
-double myriota_select_double(const int k, double *a, size_t nitems) {
-  qsort(a, nitems, sizeof(double), cmp_double);
-  return a[k];
+// Comparing rather than subtracting, which overflows for operands of
+// opposite sign and large magnitude
+static int cmp_int32(const void *ap, const void *bp) {
+  const int32_t a = *(const int32_t *)ap;
+  const int32_t b = *(const int32_t *)bp;
+  return (a > b) - (a < b);
 }
 
-static int cmp_int32(const void *a, const void *b) {
-  return (*(int32_t *)a - *(int32_t *)b);
+// Defines type name(type *a, size_t n, size_t k), which reorders a so that
+// a[k] is the element of rank k, smaller or equal elements come before it and
+// larger or equal ones after, and returns a[k].
+//
+// Introselect. Quickselect with median of three pivots and three way
+// partitions, so runs of equal elements are not partitioned again. If two
+// consecutive partitions fail to halve the range, pivots are chosen by median
+// of medians from then on, which guarantees linear time.
+#define define_select(name, type, cmp)                                       \
+  static void name##_insertion_sort(type *a, size_t n) {                     \
+    for (size_t i = 1; i < n; i++) {                                         \
+      const type x = a[i];                                                   \
+      size_t j = i;                                                          \
+      for (; j > 0 && cmp(&x, &a[j - 1]) < 0; j--) a[j] = a[j - 1];          \
+      a[j] = x;                                                              \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  static type name(type *a, size_t n, size_t k);                             \
+                                                                             \
+  /* Median of the medians of groups of 5, which are moved to the front */   \
+  static type name##_median_of_medians(type *a, size_t n) {                  \
+    size_t m = 0;                                                            \
+    for (size_t i = 0; i < n; i += 5, m++) {                                 \
+      const size_t g = n - i < 5 ? n - i : 5;                                \
+      name##_insertion_sort(a + i, g);                                       \
+      swap(type, a[m], a[i + g / 2]);                                        \
+    }                                                                        \
+    return name(a, m, m / 2);                                                \
+  }                                                                          \
+                                                                             \
+  static type name(type *a, size_t n, size_t k) {                            \
+    size_t lo = 0, hi = n; /* a[k] is in a[lo, hi) */                        \
+    size_t checkpoint = n;                                                   \
+    unsigned int partitions = 0;                                             \
+    bool linear = false;                                                     \
+    while (hi - lo > 16) {                                                   \
+      type pivot;                                                            \
+      if (linear) {                                                          \
+        pivot = name##_median_of_medians(a + lo, hi - lo);                   \
+      } else {                                                               \
+        const type *x = a + lo, *y = a + lo + (hi - lo) / 2, *z = a + hi - 1; \
+        if (cmp(x, y) > 0) swap(const type *, x, y);                         \
+        if (cmp(y, z) > 0) swap(const type *, y, z);                         \
+        if (cmp(x, y) > 0) swap(const type *, x, y);                         \
+        pivot = *y;                                                          \
+      }                                                                      \
+      /* a[lo, lt) < pivot, a[lt, gt) == pivot and a[gt, hi) > pivot */      \
+      size_t lt = lo, i = lo, gt = hi;                                       \
+      while (i < gt) {                                                       \
+        const int c = cmp(&a[i], &pivot);                                    \
+        if (c < 0) {                                                         \
+          swap(type, a[lt], a[i]);                                           \
+          lt++;                                                              \
+          i++;                                                               \
+        } else if (c > 0) {                                                  \
+          gt--;                                                              \
+          swap(type, a[i], a[gt]);                                           \
+        } else {                                                             \
+          i++;                                                               \
+        }                                                                    \
+      }                                                                      \
+      if (k < lt)                                                            \
+        hi = lt;                                                             \
+      else if (k >= gt)                                                      \
+        lo = gt;                                                             \
+      else                                                                   \
+        return a[k];                                                         \
+      if (++partitions % 2 == 0) {                                           \
+        if (hi - lo > checkpoint / 2) linear = true;                         \
+        checkpoint = hi - lo;                                                \
+      }                                                                      \
+    }                                                                        \
+    name##_insertion_sort(a + lo, hi - lo);                                  \
+    return a[k];                                                             \
+  }
+
+define_select(select_double, double, cmp_double);
+define_select(select_int32, int32_t, cmp_int32);
+
+double myriota_select_double(const int k, double *a, size_t nitems) {
+  return select_double(a, nitems, k);
 }
 
 int32_t myriota_select_int32(const int k, int32_t *a, size_t nitems) {
-  qsort(a, nitems, sizeof(int32_t), cmp_int32);
-  return a[k];
+  return select_int32(a, nitems, k);
 }
 
+// After selecting the upper median every element before it is smaller or
+// equal, so the lower median is the largest of those.
 double myriota_median_double(double *a, const size_t nitems) {
   if (nitems % 2 != 0)
     return myriota_select_double(nitems / 2, a, nitems);
   else {
     const double upper = myriota_select_double(nitems / 2, a, nitems);
-    const double lower = myriota_select_double(nitems / 2 - 1, a, nitems);
+    double lower = a[0];
+    for (size_t i = 1; i < nitems / 2; i++)
+      if (cmp_double(&a[i], &lower) > 0) lower = a[i];
     return (lower + upper) / 2.0;
   }
 }
@@ -534,11 +843,154 @@ int32_t myriota_median_int32(int32_t *a, const size_t nitems) {
     return myriota_select_int32(nitems / 2, a, nitems);
   else {
     const int64_t upper = myriota_select_int32(nitems / 2, a, nitems);
-    const int64_t lower = myriota_select_int32(nitems / 2 - 1, a, nitems);
+    int32_t lower = a[0];
+    for (size_t i = 1; i < nitems / 2; i++)
+      if (a[i] > lower) lower = a[i];
     return (lower + upper) / 2;
   }
 }
 
+// Sliding window median. The samples in the window are split between a max
+// heap holding the lower half and a min heap holding the upper half, with the
+// lower half one larger for odd counts, so the median is at the top of the
+// heaps. Samples are kept in a ring buffer and each remembers its heap and
+// position, so the oldest sample is replaced in place by the newest, which
+// is then sifted within its heap and, if it now belongs to the other half,
+// swapped with the top of the other heap.
+typedef struct {
+  unsigned int *slot;  // ring buffer index of each heap element
+  unsigned int n;
+  double sign;  // 1 for the max heap, -1 for the min heap
+} running_median_heap;
+
+struct myriota_running_median {
+  unsigned int window;
+  unsigned int count;  // samples in the window
+  unsigned int next;   // ring buffer index of the next sample
+  double *data;
+  running_median_heap **owner;  // heap of each sample
+  unsigned int *index;          // position of each sample in its heap
+  running_median_heap lower;
+  running_median_heap upper;
+};
+
+static inline double running_median_key(const myriota_running_median *m,
+                                        const running_median_heap *h,
+                                        unsigned int i) {
+  return h->sign * m->data[h->slot[i]];
+}
+
+static inline void running_median_set(myriota_running_median *m,
+                                      running_median_heap *h, unsigned int i,
+                                      unsigned int s) {
+  h->slot[i] = s;
+  m->owner[s] = h;
+  m->index[s] = i;
+}
+
+static void running_median_swap(myriota_running_median *m,
+                                running_median_heap *h, unsigned int i,
+                                unsigned int j) {
+  const unsigned int s = h->slot[i];
+  running_median_set(m, h, i, h->slot[j]);
+  running_median_set(m, h, j, s);
+}
+
+static void running_median_sift_up(myriota_running_median *m,
+                                   running_median_heap *h, unsigned int i) {
+  while (i > 0) {
+    const unsigned int p = (i - 1) / 2;
+    if (running_median_key(m, h, i) <= running_median_key(m, h, p)) break;
+    running_median_swap(m, h, i, p);
+    i = p;
+  }
+}
+
+static void running_median_sift_down(myriota_running_median *m,
+                                     running_median_heap *h, unsigned int i) {
+  while (true) {
+    unsigned int c = 2 * i + 1;
+    if (c >= h->n) break;
+    if (c + 1 < h->n &&
+        running_median_key(m, h, c + 1) > running_median_key(m, h, c))
+      c++;
+    if (running_median_key(m, h, c) <= running_median_key(m, h, i)) break;
+    running_median_swap(m, h, i, c);
+    i = c;
+  }
+}
+
+myriota_running_median *myriota_running_median_create(
+    const unsigned int window) {
+  if (window == 0) return NULL;
+  myriota_running_median *m = calloc(1, sizeof(myriota_running_median));
+  if (m == NULL) return NULL;
+  m->window = window;
+  m->data = malloc(sizeof(double) * window);
+  m->owner = malloc(sizeof(running_median_heap *) * window);
+  m->index = malloc(sizeof(unsigned int) * window);
+  m->lower.slot = malloc(sizeof(unsigned int) * (window / 2 + 1));
+  m->upper.slot = malloc(sizeof(unsigned int) * (window / 2 + 1));
+  if (m->data == NULL || m->owner == NULL || m->index == NULL ||
+      m->lower.slot == NULL || m->upper.slot == NULL) {
+    myriota_running_median_destroy(m);
+    return NULL;
+  }
+  m->lower.sign = 1;
+  m->upper.sign = -1;
+  return m;
+}
+
+void myriota_running_median_destroy(myriota_running_median *m) {
+  if (m == NULL) return;
+  free(m->data);
+  free(m->owner);
+  free(m->index);
+  free(m->lower.slot);
+  free(m->upper.slot);
+  free(m);
+}
+
+void myriota_running_median_reset(myriota_running_median *m) {
+  m->count = 0;
+  m->next = 0;
+  m->lower.n = 0;
+  m->upper.n = 0;
+}
+
+double myriota_running_median_push(myriota_running_median *m, const double x) {
+  const unsigned int s = m->next;
+  m->next = m->next + 1 == m->window ? 0 : m->next + 1;
+  m->data[s] = x;
+  if (m->count == m->window) {
+    // replaces the oldest sample, which is in slot s
+    running_median_heap *h = m->owner[s];
+    running_median_sift_up(m, h, m->index[s]);
+    running_median_sift_down(m, h, m->index[s]);
+  } else {
+    running_median_heap *h = m->lower.n == m->upper.n ? &m->lower : &m->upper;
+    running_median_set(m, h, h->n++, s);
+    running_median_sift_up(m, h, h->n - 1);
+    m->count++;
+  }
+  running_median_heap *lower = &m->lower, *upper = &m->upper;
+  if (upper->n > 0 && m->data[lower->slot[0]] > m->data[upper->slot[0]]) {
+    const unsigned int a = lower->slot[0], b = upper->slot[0];
+    running_median_set(m, lower, 0, b);
+    running_median_set(m, upper, 0, a);
+    running_median_sift_down(m, lower, 0);
+    running_median_sift_down(m, upper, 0);
+  }
+  return myriota_running_median_value(m);
+}
+
+double myriota_running_median_value(const myriota_running_median *m) {
+  if (m->count == 0) return 0;
+  const double lower = m->data[m->lower.slot[0]];
+  if (m->count % 2 != 0) return lower;
+  return (lower + m->data[m->upper.slot[0]]) / 2.0;
+}
+
 // function used internally by myriota_brent
 double myriota_brent_sign(double a, double b) {
   return fabs(a) * myriota_signum(b);
@@ -691,66 +1143,283 @@ myriota_complex myriota_discrete_fourier_transform(const unsigned int N,
   return sum;
 }
 
-// FFT/IFFT routine. (see pages 507-508 of Numerical Recipes in C)
-static void myriota_fft_internal(myriota_decimal data[], int nn, int isign) {
-  int n, mmax, m, j, istep, i;
-  myriota_decimal wtemp, wr, wpr, wpi, wi, theta;
-  myriota_decimal tempr, tempi;
-
-  n = nn << 1;
-  j = 1;
-  for (i = 1; i < n; i += 2) {
-    if (j > i) {
-      tempr = data[j - 1];
-      data[j - 1] = data[i - 1];
-      data[i - 1] = tempr;
-      tempr = data[j];
-      data[j] = data[i];
-      data[i] = tempr;
+struct myriota_fft_plan {
+  unsigned int N;
+  // Power of two N: bit reversal permutation and twiddles
+  // exp(-2 pi i m / N) for 0 <= m < 3N / 4.
+  unsigned int *reverse;
+  myriota_complex *twiddle;
+  // Other N: Bluestein's algorithm via a power of two plan of length M.
+  struct myriota_fft_plan *sub;
+  myriota_complex *chirp;   // exp(-pi i n^2 / N), 0 <= n < N
+  myriota_complex *filter;  // FFT of the conjugate chirp, length M
+  myriota_complex *work;    // length M
+};
+
+// log2 of the power of two N
+static unsigned int log2_pow2(unsigned int N) {
+  unsigned int bits = 0;
+  while ((1u << bits) < N) bits++;
+  return bits;
+}
+
+// Complex multiply without the C99 Annex G infinity and NaN handling, which
+// otherwise costs a library call per product.
+static inline myriota_complex cmul(const myriota_complex a,
+                                   const myriota_complex b) {
+  return myriota_rectangular(creal(a) * creal(b) - cimag(a) * cimag(b),
+                             creal(a) * cimag(b) + cimag(a) * creal(b));
+}
+
+// Radix-2^2 decimation in time over the bit reversed data x of length N.
+// isign=1 forward, isign=-1 inverse without scaling.
+//
+// Each radix-4 stage merges two radix-2 stages. Four consecutive transforms
+// A0, A1, A2, A3 of length L combine into one of length 4L as
+//   X[k + jL] = (A0 + W^2k A1) + (-i)^j (W^k A2 + W^3k A3), j = 0, 2
+//   X[k + jL] = (A0 - W^2k A1) + (-i)^j (W^k A2 - W^3k A3), j = 1, 3
+// where W = exp(-2 pi i / 4L), and i is replaced by -i for the inverse.
+//
+// The twiddles w are those of a plan, or if NULL are generated per stage by
+// the recurrence of Numerical Recipes, so that the plan free transforms do
+// not allocate.
+static void fft_pow2(const unsigned int N, const myriota_decimal *w,
+                     myriota_complex *x, int isign) {
+  myriota_decimal *d = (myriota_decimal *)x;  // interleaved re, im
+  unsigned int L = 1;
+  // a single radix-2 stage if log2(N) is odd
+  if (log2_pow2(N) & 1) {
+    for (unsigned int i = 0; i < 2 * N; i += 4) {
+      const myriota_decimal tr = d[i + 2], ti = d[i + 3];
+      d[i + 2] = d[i] - tr;
+      d[i + 3] = d[i + 1] - ti;
+      d[i] += tr;
+      d[i + 1] += ti;
+    }
+    L = 2;
+  }
+  for (; 4 * L <= N; L *= 4) {
+    // W^k = exp(-2 pi i k / 4L) is twiddle k * stride
+    const unsigned int stride = N / (4 * L);
+    // W^(k+1) = W^k + W^k (wpr + i wpi)
+    const myriota_decimal s = sin(-pi / (4 * L));
+    const myriota_decimal wpr = -2 * s * s, wpi = sin(-2 * pi / (4 * L));
+    myriota_decimal wr = 1, wi = 0;
+    for (unsigned int k = 0; k < L; k++) {
+      myriota_decimal w1r, w1i, w2r, w2i, w3r, w3i;
+      if (w != NULL) {
+        const unsigned int m = 2 * k * stride;
+        w1r = w[m], w1i = isign * w[m + 1];
+        w2r = w[2 * m], w2i = isign * w[2 * m + 1];
+        w3r = w[3 * m], w3i = isign * w[3 * m + 1];
+      } else {
+        w1r = wr, w1i = isign * wi;
+        w2r = w1r * w1r - w1i * w1i, w2i = 2 * w1r * w1i;
+        w3r = w2r * w1r - w2i * w1i, w3i = w2r * w1i + w2i * w1r;
+        const myriota_decimal t = wr;
+        wr += wr * wpr - wi * wpi;
+        wi += wi * wpr + t * wpi;
+      }
+      for (unsigned int i = 2 * k; i < 2 * N; i += 8 * L) {
+        myriota_decimal *x0 = d + i, *x1 = x0 + 2 * L, *x2 = x1 + 2 * L,
+                        *x3 = x2 + 2 * L;
+        const myriota_decimal a1r = x1[0] * w2r - x1[1] * w2i;
+        const myriota_decimal a1i = x1[0] * w2i + x1[1] * w2r;
+        const myriota_decimal a2r = x2[0] * w1r - x2[1] * w1i;
+        const myriota_decimal a2i = x2[0] * w1i + x2[1] * w1r;
+        const myriota_decimal a3r = x3[0] * w3r - x3[1] * w3i;
+        const myriota_decimal a3i = x3[0] * w3i + x3[1] * w3r;
+        const myriota_decimal b0r = x0[0] + a1r, b0i = x0[1] + a1i;
+        const myriota_decimal b1r = x0[0] - a1r, b1i = x0[1] - a1i;
+        const myriota_decimal c0r = a2r + a3r, c0i = a2i + a3i;
+        // c1 = -i (a2 - a3) forward, i (a2 - a3) inverse
+        const myriota_decimal c1r = isign * (a2i - a3i);
+        const myriota_decimal c1i = isign * (a3r - a2r);
+        x0[0] = b0r + c0r;
+        x0[1] = b0i + c0i;
+        x1[0] = b1r + c1r;
+        x1[1] = b1i + c1i;
+        x2[0] = b0r - c0r;
+        x2[1] = b0i - c0i;
+        x3[0] = b1r - c1r;
+        x3[1] = b1i - c1i;
+      }
+    }
+  }
+}
+
+// In place bit reversal permutation of power of two N without a table
+static void fft_pow2_reverse(const unsigned int N, myriota_complex *x) {
+  for (unsigned int i = 0, j = 0; i < N; i++) {
+    if (i < j) {
+      const myriota_complex t = x[i];
+      x[i] = x[j];
+      x[j] = t;
     }
-    m = n >> 1;
-    while (m >= 2 && j > m) {
-      j -= m;
+    unsigned int m = N >> 1;
+    while (m >= 1 && (j & m)) {
+      j ^= m;
       m >>= 1;
     }
-    j += m;
-  }
-  mmax = 2;
-  while (n > mmax) {
-    istep = 2 * mmax;
-    theta = -2 * pi / (isign * mmax);
-    wtemp = sin(0.5 * theta);
-    wpr = -2.0 * wtemp * wtemp;
-    wpi = sin(theta);
-    wr = 1.0;
-    wi = 0.0;
-    for (m = 1; m < mmax; m += 2) {
-      for (i = m; i <= n; i += istep) {
-        j = i + mmax;
-        tempr = wr * data[j - 1] - wi * data[j];
-        tempi = wr * data[j] + wi * data[j - 1];
-        data[j - 1] = data[i - 1] - tempr;
-        data[j] = data[i] - tempi;
-        data[i - 1] += tempr;
-        data[i] += tempi;
+    j |= m;
+  }
+}
+
+static void fft_pow2_permute(const myriota_fft_plan *plan,
+                             const myriota_complex *in, myriota_complex *out) {
+  const unsigned int *reverse = plan->reverse;
+  if (in == out) {
+    for (unsigned int i = 0; i < plan->N; i++) {
+      if (i < reverse[i]) {
+        const myriota_complex t = out[i];
+        out[i] = out[reverse[i]];
+        out[reverse[i]] = t;
       }
-      wr = (wtemp = wr) * wpr - wi * wpi + wr;
-      wi = wi * wpr + wtemp * wpi + wi;
     }
-    mmax = istep;
+  } else {
+    for (unsigned int i = 0; i < plan->N; i++) out[reverse[i]] = in[i];
+  }
+}
+
+static myriota_fft_plan *fft_plan_create_pow2(const unsigned int N) {
+  myriota_fft_plan *plan = calloc(1, sizeof(myriota_fft_plan));
+  if (plan == NULL) return NULL;
+  plan->N = N;
+  plan->reverse = malloc(sizeof(unsigned int) * N);
+  plan->twiddle = malloc(sizeof(myriota_complex) * (3 * N / 4 + 1));
+  if (plan->reverse == NULL || plan->twiddle == NULL) {
+    myriota_fft_plan_destroy(plan);
+    return NULL;
+  }
+
+  const unsigned int bits = log2_pow2(N);
+  plan->reverse[0] = 0;
+  for (unsigned int i = 1; i < N; i++)
+    plan->reverse[i] = (plan->reverse[i >> 1] >> 1) | ((i & 1) << (bits - 1));
+
+  // Only the first octant needs sin and cos, the rest follows by symmetry
+  myriota_complex *w = plan->twiddle;
+  const unsigned int Q = N / 4;
+  for (unsigned int m = 0; m <= Q; m++) {
+    if (N < 8 || m <= N / 8)
+      w[m] = myriota_polar(1, -2 * pi * m / N);
+    else  // exp(-i (pi / 2 - t)) = -i conj(exp(-i t))
+      w[m] = myriota_rectangular(-cimag(w[Q - m]), -creal(w[Q - m]));
+  }
+  for (unsigned int m = Q + 1; m < 3 * Q; m++)  // multiply by -i
+    w[m] = myriota_rectangular(cimag(w[m - Q]), -creal(w[m - Q]));
+  return plan;
+}
+
+static myriota_fft_plan *fft_plan_create_bluestein(const unsigned int N) {
+  myriota_fft_plan *plan = calloc(1, sizeof(myriota_fft_plan));
+  if (plan == NULL) return NULL;
+  plan->N = N;
+  const unsigned int M = myriota_greater_power_of_two(2 * N - 1);
+  plan->sub = fft_plan_create_pow2(M);
+  plan->chirp = malloc(sizeof(myriota_complex) * N);
+  plan->filter = calloc(M, sizeof(myriota_complex));
+  plan->work = malloc(sizeof(myriota_complex) * M);
+  if (plan->sub == NULL || plan->chirp == NULL || plan->filter == NULL ||
+      plan->work == NULL) {
+    myriota_fft_plan_destroy(plan);
+    return NULL;
+  }
+
+  for (uint64_t n = 0; n < N; n++) {
+    // n^2 mod 2N keeps the argument small and exact
+    plan->chirp[n] = myriota_polar(1, -pi * ((n * n) % (2 * N)) / N);
+    plan->filter[n] = conj(plan->chirp[n]);
+    if (n > 0) plan->filter[M - n] = conj(plan->chirp[n]);
   }
+  fft_pow2_permute(plan->sub, plan->filter, plan->filter);
+  fft_pow2(M, (const myriota_decimal *)plan->sub->twiddle, plan->filter,
+           1);
+  return plan;
 }
 
-// Does forward and inverse ffts,
+myriota_fft_plan *myriota_fft_plan_create(const unsigned int N) {
+  if (N == 0) return NULL;
+  if (myriota_is_power_of_two(N)) return fft_plan_create_pow2(N);
+  return fft_plan_create_bluestein(N);
+}
+
+void myriota_fft_plan_destroy(myriota_fft_plan *plan) {
+  if (plan == NULL) return;
+  free(plan->reverse);
+  free(plan->twiddle);
+  myriota_fft_plan_destroy(plan->sub);
+  free(plan->chirp);
+  free(plan->filter);
+  free(plan->work);
+  free(plan);
+}
+
+unsigned int myriota_fft_plan_length(const myriota_fft_plan *plan) {
+  return plan->N;
+}
+
+// Does forward and inverse ffts without scaling,
 // isign=1 forward, isign=-1 inverse
+static void fft_execute(myriota_fft_plan *plan, const myriota_complex *in,
+                        myriota_complex *out, int isign) {
+  const unsigned int N = plan->N;
+  if (plan->sub == NULL) {
+    fft_pow2_permute(plan, in, out);
+    fft_pow2(N, (const myriota_decimal *)plan->twiddle, out, isign);
+    return;
+  }
+  // Bluestein, the inverse is conj(FFT(conj(x)))
+  const unsigned int M = plan->sub->N;
+  myriota_complex *a = plan->work;
+  for (unsigned int n = 0; n < N; n++)
+    a[n] = cmul(isign < 0 ? conj(in[n]) : in[n], plan->chirp[n]);
+  for (unsigned int n = N; n < M; n++) a[n] = 0;
+  const myriota_decimal *w = (const myriota_decimal *)plan->sub->twiddle;
+  fft_pow2_permute(plan->sub, a, a);
+  fft_pow2(M, w, a, 1);
+  for (unsigned int m = 0; m < M; m++) a[m] = cmul(a[m], plan->filter[m]);
+  fft_pow2_permute(plan->sub, a, a);
+  fft_pow2(M, w, a, -1);
+  for (unsigned int k = 0; k < N; k++) {
+    const myriota_complex X = cmul(a[k], plan->chirp[k]) / M;
+    out[k] = isign < 0 ? conj(X) : X;
+  }
+}
+
+void myriota_fft_execute(myriota_fft_plan *plan, const myriota_complex *in,
+                         myriota_complex *out) {
+  fft_execute(plan, in, out, 1);
+}
+
+void myriota_inverse_fft_execute(myriota_fft_plan *plan,
+                                 const myriota_complex *in,
+                                 myriota_complex *out) {
+  fft_execute(plan, in, out, -1);
+  for (unsigned int n = 0; n < plan->N; n++) out[n] /= plan->N;
+}
+
+// Does forward and inverse ffts, in place without allocating for power of two
+// N and with a temporary plan otherwise, isign=1 forward, isign=-1 inverse
 static void myriota_fft_internal2(const unsigned int N,
                                   const myriota_complex *in,
                                   myriota_complex *out, int isign) {
-  if (!myriota_is_power_of_two(N)) {
-    error_message_and_exit(" N must be a power of 2 for FFT \n");
+  if (N == 0) return;
+  if (myriota_is_power_of_two(N)) {
+    if (in != out) memcpy(out, in, sizeof(myriota_complex) * N);
+    fft_pow2_reverse(N, out);
+    fft_pow2(N, NULL, out, isign);
+    if (isign < 0)
+      for (unsigned int n = 0; n < N; n++) out[n] /= N;
+    return;
   }
-  if (in != out) memcpy(out, in, sizeof(myriota_complex) * N);
-  myriota_fft_internal((myriota_decimal *)out, N, isign);
+  myriota_fft_plan *plan = myriota_fft_plan_create(N);
+  if (plan == NULL) error_message_and_exit(" Out of memory for FFT plan \n");
+  if (isign > 0)
+    myriota_fft_execute(plan, in, out);
+  else
+    myriota_inverse_fft_execute(plan, in, out);
+  myriota_fft_plan_destroy(plan);
 }
 
 void myriota_fft(const unsigned int N, const myriota_complex *in,
@@ -761,7 +1430,6 @@ void myriota_fft(const unsigned int N, const myriota_complex *in,
 void myriota_inverse_fft(const unsigned int N, const myriota_complex *in,
                          myriota_complex *out) {
   myriota_fft_internal2(N, in, out, -1);
-  for (int n = 0; n < N; n++) out[n] /= N;
 }
 
 // The complex Phi function.
@@ -830,36 +1498,72 @@ double periodogram_brent_time_domain(const double f, void *data) {
   return -periodogram_standard(f, p->F, p->N);
 }
 
-void myriota_detect_sinusoid_inplace(myriota_complex *x, const unsigned int N,
-                                     myriota_decimal *frequency,
-                                     myriota_complex *amplitude,
-                                     myriota_decimal *residual_variance,
-                                     myriota_decimal *confidence) {
-  // compute residual variance
+typedef struct {
+  const myriota_complex *F;
+  int N;
+  int M;
+  int centre;
+  int neighbourhood;
+} periodogram_brent_local_data;
+
+// Periodogram from the frequency domain samples F[k] with
+// |k - centre| <= neighbourhood only, an approximation of
+// periodogram_frequency_domain for f near centre / M.
+double periodogram_brent_frequency_domain_local(const double f, void *data) {
+  const periodogram_brent_local_data *p = data;
+  myriota_complex v = 0;
+  for (int k = p->centre - p->neighbourhood;
+       k <= p->centre + p->neighbourhood; k++) {
+    const myriota_complex phi =
+        periodogram_phi((1.0 * k) / p->M - f, p->N, p->M);
+    v += p->F[((k % p->M) + p->M) % p->M] * phi;
+  }
+  return -myriota_complex_norm(v) / p->N;
+}
+
+// Mean of |x[n]|^2
+static double sinusoid_signal_power(const myriota_complex *x,
+                                    const unsigned int N) {
   double sigma2 = 0.0;
   for (int n = 0; n < N; n++) sigma2 += myriota_complex_norm(x[n]) / N;
+  return sigma2;
+}
 
-  // compute fft, mutates input array x
-  unsigned int M = myriota_greater_power_of_two(N);
-  myriota_fft(M, x, x);
-
-  // find maximiser of the fft
-  double Imax = myriota_complex_norm(x[0]);
+// Index of the largest |F[k]|
+static unsigned int sinusoid_spectrum_argmax(const myriota_complex *F,
+                                             const unsigned int M) {
+  double Imax = myriota_complex_norm(F[0]);
   unsigned int nhat = 0;
   for (int n = 1; n < M; n++) {
-    double thisnorm = myriota_complex_norm(x[n]);
+    double thisnorm = myriota_complex_norm(F[n]);
     if (Imax < thisnorm) {
       nhat = n;
       Imax = thisnorm;
     }
   }
-
-  // refine the periodogram using Brents method
-  periodogram_brent_data data = {x, N, M};
-  double xhat;
-  myriota_inverse_fft(M, x, x);
-  myriota_brent(periodogram_brent_time_domain, &data, (nhat - 0.5) / M,
-                1.0 * nhat / M, (nhat + 0.5) / M, &Imax, &xhat, 1e-6, 100);
+  return nhat;
+}
+
+// Refine the periodogram maximiser near bin nhat using Brents method, then
+// fill in the estimates. The time domain periodogram of x is used if
+// neighbourhood is zero, otherwise the frequency domain periodogram from the
+// bins of F within neighbourhood of nhat.
+static void sinusoid_refine(const myriota_complex *x, const myriota_complex *F,
+                            const unsigned int N, const unsigned int M,
+                            const unsigned int nhat, const double sigma2,
+                            const unsigned int neighbourhood,
+                            myriota_sinusoid *result) {
+  double Imax, xhat;
+  if (neighbourhood == 0) {
+    periodogram_brent_data data = {x, N, M};
+    myriota_brent(periodogram_brent_time_domain, &data, (nhat - 0.5) / M,
+                  1.0 * nhat / M, (nhat + 0.5) / M, &Imax, &xhat, 1e-6, 100);
+  } else {
+    periodogram_brent_local_data data = {F, N, M, nhat, neighbourhood};
+    myriota_brent(periodogram_brent_frequency_domain_local, &data,
+                  (nhat - 0.5) / M, 1.0 * nhat / M, (nhat + 0.5) / M, &Imax,
+                  &xhat, 1e-6, 100);
+  }
   Imax *= -1;  // Brent's method minimises, so need to invert
 
   // compute confidence (complex version of the Turkman-Walker test)
@@ -868,36 +1572,154 @@ void myriota_detect_sinusoid_inplace(myriota_complex *x, const unsigned int N,
   double cN = 2 * log(N) - log(log(N)) + log(3 / pi);
   double MN = Imax / sigma2 - cN / 2;
 
-  *confidence = exp(-exp(-MN));
-  *frequency = myriota_fracpart(xhat);
-  *residual_variance = fmax(0.0, sigma2 - Imax / N);
-  *amplitude = periodogram_time_domain_v(xhat, x, N) / N;
+  result->confidence = exp(-exp(-MN));
+  result->frequency = myriota_fracpart(xhat);
+  result->residual_variance = fmax(0.0, sigma2 - Imax / N);
+  result->amplitude = periodogram_time_domain_v(xhat, x, N) / N;
+}
+
+void myriota_detect_sinusoid_inplace(myriota_complex *x, const unsigned int N,
+                                     myriota_decimal *frequency,
+                                     myriota_complex *amplitude,
+                                     myriota_decimal *residual_variance,
+                                     myriota_decimal *confidence) {
+  // compute residual variance
+  const double sigma2 = sinusoid_signal_power(x, N);
+
+  // compute fft, mutates input array x
+  unsigned int M = myriota_greater_power_of_two(N);
+  myriota_fft(M, x, x);
+
+  // find maximiser of the fft
+  const unsigned int nhat = sinusoid_spectrum_argmax(x, M);
+
+  // refine the periodogram in the time domain
+  myriota_inverse_fft(M, x, x);
+  myriota_sinusoid result;
+  sinusoid_refine(x, NULL, N, M, nhat, sigma2, 0, &result);
+
+  *confidence = result.confidence;
+  *frequency = result.frequency;
+  *residual_variance = result.residual_variance;
+  *amplitude = result.amplitude;
+}
+
+typedef struct {
+  const myriota_complex *x;
+  unsigned int N;
+  unsigned int hop;
+  unsigned int first;  // windows first <= w < last
+  unsigned int last;
+  unsigned int neighbourhood;
+  myriota_sinusoid *result;
+  int status;
+} sinusoid_batch;
+
+// Detect sinusoids in a range of windows with one plan and one scratch buffer
+static void *sinusoid_batch_run(void *arg) {
+  sinusoid_batch *b = arg;
+  const unsigned int N = b->N;
+  const unsigned int M = myriota_greater_power_of_two(N);
+  myriota_fft_plan *plan = myriota_fft_plan_create(M);
+  myriota_complex *F = malloc(sizeof(myriota_complex) * M);
+  b->status = plan != NULL && F != NULL ? 0 : -1;
+  for (unsigned int w = b->first; w < b->last && b->status == 0; w++) {
+    const myriota_complex *x = b->x + (size_t)w * b->hop;
+    memcpy(F, x, sizeof(myriota_complex) * N);
+    for (unsigned int n = N; n < M; n++) F[n] = 0;
+    myriota_fft_execute(plan, F, F);
+    const unsigned int nhat = sinusoid_spectrum_argmax(F, M);
+    sinusoid_refine(x, F, N, M, nhat, sinusoid_signal_power(x, N),
+                    b->neighbourhood, &b->result[w]);
+  }
+  free(F);
+  myriota_fft_plan_destroy(plan);
+  return NULL;
 }
 
+#if defined(__unix__)
+#define MYRIOTA_MAX_SINUSOID_THREADS 64
+#else
+#define MYRIOTA_MAX_SINUSOID_THREADS 1
+#endif
+
+int myriota_detect_sinusoids(const myriota_complex *x, const unsigned int N,
+                             const unsigned int hop, const unsigned int count,
+                             const unsigned int neighbourhood,
+                             unsigned int threads, myriota_sinusoid *result) {
+  if (N == 0) return -1;
+  if (threads < 1) threads = 1;
+  if (threads > MYRIOTA_MAX_SINUSOID_THREADS)
+    threads = MYRIOTA_MAX_SINUSOID_THREADS;
+  if (threads > count) threads = count;
+
+  sinusoid_batch batch[MYRIOTA_MAX_SINUSOID_THREADS];
+  for (unsigned int t = 0; t < threads; t++) {
+    const sinusoid_batch b = {x,
+                              N,
+                              hop,
+                              (uint64_t)count * t / threads,
+                              (uint64_t)count * (t + 1) / threads,
+                              neighbourhood,
+                              result,
+                              0};
+    batch[t] = b;
+  }
+
+#if defined(__unix__)
+  pthread_t thread[MYRIOTA_MAX_SINUSOID_THREADS];
+  bool started[MYRIOTA_MAX_SINUSOID_THREADS] = {false};
+  for (unsigned int t = 1; t < threads; t++)
+    started[t] =
+        pthread_create(&thread[t], NULL, sinusoid_batch_run, &batch[t]) == 0;
+  // the calling thread takes the first range, and any range whose thread
+  // failed to start
+  for (unsigned int t = 0; t < threads; t++)
+    if (!started[t]) sinusoid_batch_run(&batch[t]);
+  for (unsigned int t = 1; t < threads; t++)
+    if (started[t]) pthread_join(thread[t], NULL);
+#else
+  for (unsigned int t = 0; t < threads; t++) sinusoid_batch_run(&batch[t]);
+#endif
+
+  for (unsigned int t = 0; t < threads; t++)
+    if (batch[t].status != 0) return -1;
+  return 0;
+}
+
+// Blocks of B in myriota_matrix_multiply, sized to stay in cache
+#define GEMM_BLOCK_ROWS 32
+#define GEMM_BLOCK_COLUMNS 128
+
+// Accumulates a block of B at a time into whole rows of X. Each product is
+// still summed over n in order, as the direct triple loop would.
 void myriota_matrix_multiply(const int M, const int N, const int K,
                              const double *A, const double *B, double *X) {
-  for (int m = 0; m < M; m++) {
-    for (int k = 0; k < K; k++) {
-      double x = 0;
-      for (int n = 0; n < N; n++) x += *(A + N * m + n) * *(B + K * n + k);
-      *(X + K * m + k) = x;
+  for (int i = 0; i < M * K; i++) X[i] = 0;
+  for (int k = 0; k < K; k += GEMM_BLOCK_COLUMNS) {
+    const int columns = myriota_int_min(GEMM_BLOCK_COLUMNS, K - k);
+    for (int n = 0; n < N; n += GEMM_BLOCK_ROWS) {
+      const int rows = myriota_int_min(GEMM_BLOCK_ROWS, N - n);
+      for (int m = 0; m < M; m++)
+        myriota_axpy_rows(rows, A + N * m + n, B + K * n + k, K, columns,
+                          X + K * m + k);
     }
   }
 }
 
+// Square tiles so that both the rows read and the columns written by
+// myriota_matrix_transpose stay in cache
+#define TRANSPOSE_BLOCK 16
+
 void myriota_matrix_transpose(const int M, const int N, const double *A,
                               double *B) {
-  for (int m = 0; m < M; m++)
-    for (int n = 0; n < N; n++) *(B + M * n + m) = *(A + N * m + n);
+  for (int m0 = 0; m0 < M; m0 += TRANSPOSE_BLOCK)
+    for (int n0 = 0; n0 < N; n0 += TRANSPOSE_BLOCK)
+      for (int m = m0; m < myriota_int_min(m0 + TRANSPOSE_BLOCK, M); m++)
+        for (int n = n0; n < myriota_int_min(n0 + TRANSPOSE_BLOCK, N); n++)
+          *(B + M * n + m) = *(A + N * m + n);
 }
 
-#define swap(type, a, b) \
-  {                      \
-    const type t = a;    \
-    a = b;               \
-    b = t;               \
-  }
-
 #define comp_LU(M, N, A, LU, piv)                                     \
   {                                                                   \
     for (int m = 0; m < M; m++)                                       \
@@ -991,18 +1813,164 @@ void myriota_matrix_print(const int M, const int N, const double *A, FILE *f) {
   }
 }
 
+int myriota_matrix_cholesky(const int N, double *A) {
+  for (int j = 0; j < N; j++) {
+    double *Aj = A + N * j;
+    double d = Aj[j];
+    for (int k = 0; k < j; k++) d -= Aj[k] * Aj[k];
+    // pivots lost to rounding error mean A is singular
+    if (!(d > N * 2.2e-16 * fabs(Aj[j]))) return -1;
+    const double l = sqrt(d);
+    Aj[j] = l;
+    for (int i = j + 1; i < N; i++) {
+      double *Ai = A + N * i;
+      double s = Ai[j];
+      for (int k = 0; k < j; k++) s -= Ai[k] * Aj[k];
+      Ai[j] = s / l;
+    }
+  }
+  for (int m = 0; m < N; m++)
+    for (int n = m + 1; n < N; n++) *(A + N * m + n) = 0.0;  // upper zeros
+  return 0;
+}
+
+void myriota_matrix_cholesky_solve(const int N, const int K, const double *L,
+                                   double *Y) {
+  // Solve LZ = Y
+  for (int i = 0; i < N; i++) {
+    for (int k = 0; k < i; k++)
+      for (int j = 0; j < K; j++) Y[K * i + j] -= L[N * i + k] * Y[K * k + j];
+    for (int j = 0; j < K; j++) Y[K * i + j] /= L[N * i + i];
+  }
+  // Solve L^T X = Z
+  for (int i = N - 1; i >= 0; i--) {
+    for (int k = i + 1; k < N; k++)
+      for (int j = 0; j < K; j++) Y[K * i + j] -= L[N * k + i] * Y[K * k + j];
+    for (int j = 0; j < K; j++) Y[K * i + j] /= L[N * i + i];
+  }
+}
+
+int myriota_matrix_least_squares(const int M, const int N, const int K,
+                                 double *A, double *Y) {
+  if (M < N) return -1;
+  for (int j = 0; j < N; j++) {
+    // Householder reflection I - beta v v^T taking column j below the
+    // diagonal to alpha e_j, with v stored over the column
+    double norm = 0;
+    for (int i = j; i < M; i++) norm += A[N * i + j] * A[N * i + j];
+    norm = sqrt(norm);
+    if (norm == 0) return -1;
+    const double alpha = A[N * j + j] > 0 ? -norm : norm;
+    A[N * j + j] -= alpha;
+    const double beta = -1 / (alpha * A[N * j + j]);
+    for (int c = j + 1; c < N; c++) {
+      double s = 0;
+      for (int i = j; i < M; i++) s += A[N * i + j] * A[N * i + c];
+      s *= beta;
+      for (int i = j; i < M; i++) A[N * i + c] -= s * A[N * i + j];
+    }
+    for (int c = 0; c < K; c++) {
+      double s = 0;
+      for (int i = j; i < M; i++) s += A[N * i + j] * Y[K * i + c];
+      s *= beta;
+      for (int i = j; i < M; i++) Y[K * i + c] -= s * A[N * i + j];
+    }
+    A[N * j + j] = alpha;
+  }
+  // relative to the largest diagonal element of R
+  double rmax = 0;
+  for (int j = 0; j < N; j++) rmax = fmax(rmax, fabs(A[N * j + j]));
+  for (int j = 0; j < N; j++)
+    if (fabs(A[N * j + j]) <= N * 2.2e-16 * rmax) return -1;
+  // Solve RX = Q^T Y
+  for (int i = N - 1; i >= 0; i--) {
+    for (int k = i + 1; k < N; k++)
+      for (int j = 0; j < K; j++) Y[K * i + j] -= A[N * i + k] * Y[K * k + j];
+    for (int j = 0; j < K; j++) Y[K * i + j] /= A[N * i + i];
+  }
+  return 0;
+}
+
+// Writes the n coefficients a of the polynomial in t with the coefficients b
+// in the shifted variable u = t - t0, by Horner's scheme in u, b(u) = b[0] +
+// u (b[1] + ...), multiplying by u = t - t0 one step at a time
+static void _polyfit_unshift(const int n, const double t0, const double *b,
+                             double *a) {
+  for (int k = 0; k < n; k++) a[k] = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    for (int k = n - 1; k > 0; k--) a[k] = a[k - 1] - t0 * a[k];
+    a[0] = b[i] - t0 * a[0];
+  }
+}
+
+// Orders the streaming fit can hold use it. Higher orders, and fits too ill
+// conditioned for its Cholesky factorisation, solve the full N by r + 1
+// matrix of powers of u = t - t[0] by QR on the heap, without forming the
+// normal equations
 void myriota_polyfit(const double *t, const double *x, const int N, const int r,
                      double *a) {
-  double T[N][r + 1];
-  for (int n = 0; n < N; n++)
-    for (int i = 0; i <= r; i++) T[n][i] = pow(t[n], i);
-  double Tt[r + 1][N];
-  myriota_matrix_transpose(N, r + 1, &T[0][0], &Tt[0][0]);
-  double TtT[r + 1][r + 1];
-  myriota_matrix_multiply(r + 1, N, r + 1, &Tt[0][0], &T[0][0], &TtT[0][0]);
-  double Tx[r + 1];
-  myriota_matrix_multiply(r + 1, N, 1, &Tt[0][0], x, Tx);
-  myriota_matrix_solve(r + 1, 1, &TtT[0][0], Tx, a);
+  if (r < 0 || N <= r) return;  // never unique
+  if (r <= MYRIOTA_POLYFIT_MAX_ORDER) {
+    myriota_polyfit_state p;
+    myriota_polyfit_init(&p, r);
+    for (int n = 0; n < N; n++) myriota_polyfit_add(&p, t[n], x[n]);
+    if (myriota_polyfit_solve(&p, a) == 0) return;
+  }
+  const int n = r + 1;
+  double *U = malloc(sizeof(double) * N * n);
+  double *b = malloc(sizeof(double) * N);
+  if (U && b) {
+    for (int i = 0; i < N; i++) {
+      const double u = t[i] - t[0];
+      double uk = 1;  // u^k
+      for (int k = 0; k < n; k++, uk *= u) U[n * i + k] = uk;
+      b[i] = x[i];
+    }
+    if (myriota_matrix_least_squares(N, n, 1, U, b) == 0)
+      _polyfit_unshift(n, t[0], b, a);
+  }
+  free(U);
+  free(b);
+}
+
+int myriota_polyfit_init(myriota_polyfit_state *p, const int r) {
+  if (r < 0 || r > MYRIOTA_POLYFIT_MAX_ORDER) return -1;
+  p->r = r;
+  p->n = 0;
+  p->t0 = 0;
+  for (int k = 0; k <= 2 * r; k++) p->S[k] = 0;
+  for (int k = 0; k <= r; k++) p->Sx[k] = 0;
+  return 0;
+}
+
+void myriota_polyfit_add(myriota_polyfit_state *p, const double t,
+                         const double x) {
+  if (p->n++ == 0) p->t0 = t;
+  const double u = t - p->t0;
+  double uk = 1;  // u^k
+  for (int k = 0; k <= p->r; k++, uk *= u) {
+    p->S[k] += uk;
+    p->Sx[k] += uk * x;
+  }
+  for (int k = p->r + 1; k <= 2 * p->r; k++, uk *= u) p->S[k] += uk;
+}
+
+// The normal equations T^T T b = T^T x have the Hankel matrix
+// (T^T T)[i][j] = S[i + j], which is positive definite when the fit is unique.
+// The coefficients b of the polynomial in u = t - t0 are then expanded into
+// powers of t.
+int myriota_polyfit_solve(const myriota_polyfit_state *p, double *a) {
+  const int n = p->r + 1;
+  double TtT[(MYRIOTA_POLYFIT_MAX_ORDER + 1) * (MYRIOTA_POLYFIT_MAX_ORDER + 1)];
+  double b[MYRIOTA_POLYFIT_MAX_ORDER + 1];
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) TtT[n * i + j] = p->S[i + j];
+    b[i] = p->Sx[i];
+  }
+  if (myriota_matrix_cholesky(n, TtT) != 0) return -1;
+  myriota_matrix_cholesky_solve(n, 1, TtT, b);
+  _polyfit_unshift(n, p->t0, b, a);
+  return 0;
 }
 
 unsigned int myriota_tlv_size(const void *tlv,
@@ -1045,8 +2013,9 @@ void *myriota_tlv_next(const void *tlv, unsigned int (*size)(const void *)) {
 void *myriota_tlv_get(int i, const void *tlv,
                       unsigned int (*size)(const void *)) {
   if (size(tlv) == 0) return NULL;
-  if (i <= 0) return (void *)tlv;
-  return myriota_tlv_get(i - 1, myriota_tlv_next(tlv, size), size);
+  for (; i > 0; i--)
+    if ((tlv = myriota_tlv_next(tlv, size)) == NULL) return NULL;
+  return (void *)tlv;
 }
 
 int myriota_tlv_append(void *tlv, const void *a,
@@ -1109,6 +2078,127 @@ int myriota_tlv_filter(const void *tlv, unsigned int (*size)(const void *),
   return i;
 }
 
+static int tlv_index_reserve(myriota_tlv_index *x, const unsigned int n) {
+  if (n <= x->capacity) return 0;
+  unsigned int c = x->capacity ? x->capacity : 16;
+  while (c < n) c *= 2;
+  unsigned int *offset = realloc(x->offset, sizeof(unsigned int) * c);
+  if (offset == NULL) return -1;
+  x->offset = offset;
+  x->capacity = c;
+  return 0;
+}
+
+int myriota_tlv_index_init(myriota_tlv_index *x, void *tlv,
+                           unsigned int (*size)(const void *),
+                           int (*end)(void *)) {
+  x->tlv = tlv;
+  x->size = size;
+  x->end = end;
+  x->offset = NULL;
+  x->count = 0;
+  x->capacity = 0;
+  x->total = 0;
+  if (tlv == NULL) return -1;
+  for (const uint8_t *e = tlv; size(e) != 0; e += size(e)) {
+    if (tlv_index_reserve(x, x->count + 1) != 0) return -1;
+    x->offset[x->count++] = x->total;
+    x->total += size(e);
+  }
+  return 0;
+}
+
+void myriota_tlv_index_free(myriota_tlv_index *x) {
+  free(x->offset);
+  x->offset = NULL;
+  x->count = 0;
+  x->capacity = 0;
+}
+
+void *myriota_tlv_index_get(const myriota_tlv_index *x, const unsigned int i) {
+  if (i >= x->count) return NULL;
+  return (uint8_t *)x->tlv + x->offset[i];
+}
+
+int myriota_tlv_index_append(myriota_tlv_index *x, const void *a) {
+  if (a == NULL) return -1;
+  const unsigned int as = x->size(a);
+  if (as == 0) return -1;
+  if (tlv_index_reserve(x, x->count + 1) != 0) return -1;
+  uint8_t *t = (uint8_t *)x->tlv + x->total;
+  memmove(t, a, as);
+  x->end(t + as);
+  x->offset[x->count++] = x->total;
+  x->total += as;
+  return 0;
+}
+
+int myriota_tlv_index_delete(myriota_tlv_index *x, const unsigned int i) {
+  if (i >= x->count) return -1;
+  uint8_t *t = (uint8_t *)x->tlv;
+  const unsigned int ds = x->size(t + x->offset[i]);
+  const unsigned int tail = x->total - x->offset[i] - ds;
+  memmove(t + x->offset[i], t + x->offset[i] + ds, tail);
+  x->total -= ds;
+  x->end(t + x->total);
+  for (unsigned int j = i + 1; j < x->count; j++)
+    x->offset[j - 1] = x->offset[j] - ds;
+  x->count--;
+  return 0;
+}
+
+unsigned int myriota_tlv_index_count_find(const myriota_tlv_index *x,
+                                          bool (*find)(const void *, void *),
+                                          void *find_state) {
+  const uint8_t *t = x->tlv;
+  unsigned int c = 0;
+  for (unsigned int i = 0; i < x->count; i++)
+    if (find(t + x->offset[i], find_state)) c++;
+  return c;
+}
+
+void *myriota_tlv_index_get_find(const myriota_tlv_index *x, int i,
+                                 bool (*find)(const void *, void *),
+                                 void *find_state) {
+  uint8_t *t = x->tlv;
+  if (i < 0) return NULL;
+  for (unsigned int j = 0; j < x->count; j++)
+    if (find(t + x->offset[j], find_state) && i-- == 0) return t + x->offset[j];
+  return NULL;
+}
+
+// Runs of consecutive kept elements are moved down together, once the next
+// deleted element, or the end, is reached
+unsigned int myriota_tlv_index_delete_find(myriota_tlv_index *x,
+                                           bool (*f)(const void *, void *),
+                                           void *f_state) {
+  uint8_t *t = (uint8_t *)x->tlv;
+  unsigned int w = 0;          // bytes kept and moved into place
+  unsigned int run = 0;        // offset of the pending run of kept elements
+  unsigned int run_size = 0;   // bytes in the pending run
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < x->count; i++) {
+    const uint8_t *e = t + x->offset[i];
+    const unsigned int s = x->size(e);
+    if (f(e, f_state)) {
+      memmove(t + w, t + run, run_size);
+      w += run_size;
+      run_size = 0;
+    } else {
+      if (run_size == 0) run = x->offset[i];
+      x->offset[kept++] = w + run_size;
+      run_size += s;
+    }
+  }
+  memmove(t + w, t + run, run_size);
+  w += run_size;
+  const unsigned int deleted = x->count - kept;
+  if (deleted > 0) x->end(t + w);
+  x->count = kept;
+  x->total = w;
+  return deleted;
+}
+
 void *myriota_tlv_from_file(FILE *f, int (*end)(void *)) {
   if (f == NULL) return NULL;
   const int end_size = end(NULL);  // size of terminator
@@ -1124,19 +2214,238 @@ void *myriota_tlv_from_file(FILE *f, int (*end)(void *)) {
   return buf;
 }
 
+#if defined(__unix__)
+// The file is mapped over an anonymous reservation at least a page longer, so
+// size() may read past the end of the file and there is always room for the
+// terminating value
+int myriota_tlv_map_file(const char *path, unsigned int (*size)(const void *),
+                         int (*end)(void *), myriota_tlv_map *m) {
+  memset(m, 0, sizeof(*m));
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  const size_t L = st.st_size;
+  const size_t page = sysconf(_SC_PAGESIZE);
+  const size_t end_size = end(NULL);
+  const size_t length =
+      (L + page - 1) / page * page + (end_size + page - 1) / page * page;
+  uint8_t *base = (uint8_t *)mmap(NULL, length, PROT_READ,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  if (L > 0 && mmap(base, L, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+                   MAP_FAILED) {
+    munmap(base, length);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  // find the terminating value, or the end of the last whole element
+  size_t o = 0;
+  bool terminated = false;
+  while (o < L) {
+    const size_t s = size(base + o);
+    if (s == 0) {
+      terminated = o + end_size <= L;
+      break;
+    }
+    if (s > L - o) break;  // element continues past the end of the file
+    o += s;
+  }
+  if (!terminated) {
+    uint8_t *first = base + o / page * page;
+    const size_t n = base + o + end_size - first;
+    if (mprotect(first, n, PROT_READ | PROT_WRITE) != 0) {
+      munmap(base, length);
+      return -1;
+    }
+    end(base + o);
+    mprotect(first, n, PROT_READ);
+  }
+  m->tlv = base;
+  m->size = o + end_size;
+  m->base = base;
+  m->length = length;
+  return 0;
+}
+
+void myriota_tlv_unmap_file(myriota_tlv_map *m) {
+  if (m->base != NULL) munmap(m->base, m->length);
+  memset(m, 0, sizeof(*m));
+}
+#endif
+
+int myriota_tlv_stream_init(myriota_tlv_stream *s, FILE *f,
+                            unsigned int (*size)(const void *),
+                            int (*end)(void *), const size_t max_size) {
+  memset(s, 0, sizeof(*s));
+  if (f == NULL || max_size == 0) return -1;
+  s->f = f;
+  s->size = size;
+  s->end = end;
+  s->max_size = max_size;
+  s->capacity = 4 * max_size > (1 << 16) ? 4 * max_size : 1 << 16;
+  s->buf = (uint8_t *)malloc(s->capacity + end(NULL));
+  return s->buf == NULL ? -1 : 0;
+}
+
+void myriota_tlv_stream_free(myriota_tlv_stream *s) {
+  free(s->buf);
+  s->buf = NULL;
+}
+
+// Reads whenever fewer than max_size bytes remain, so the next element is
+// always whole in the buffer
+const void *myriota_tlv_stream_next(myriota_tlv_stream *s) {
+  if (s->buf == NULL) return NULL;
+  if (!s->eof && s->fill - s->position < s->max_size) {
+    s->fill -= s->position;
+    memmove(s->buf, s->buf + s->position, s->fill);
+    s->position = 0;
+    s->fill += fread(s->buf + s->fill, 1, s->capacity - s->fill, s->f);
+    if (s->fill < s->capacity) {
+      s->eof = true;
+      s->end(s->buf + s->fill);  // add terminator
+    }
+  }
+  const uint8_t *e = s->buf + s->position;
+  const unsigned int es = s->size(e);
+  if (es == 0 || es > s->fill - s->position) return NULL;
+  s->position += es;
+  return e;
+}
+
+const void *myriota_tlv_stream_find(myriota_tlv_stream *s,
+                                    bool (*f)(const void *, void *),
+                                    void *f_state) {
+  const void *e;
+  while ((e = myriota_tlv_stream_next(s)) != NULL)
+    if (f(e, f_state)) return e;
+  return NULL;
+}
+
+static void swap_bytes(uint8_t *a, uint8_t *b, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    const uint8_t t = a[i];
+    a[i] = b[i];
+    b[i] = t;
+  }
+}
+
+// Moves element i of the max heap of n elements at t down to its place
+static void sift_down(uint8_t *t, size_t i, size_t n, size_t size,
+                      int (*cmp)(const void *, const void *)) {
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= n) return;
+    if (c + 1 < n && cmp(t + c * size, t + (c + 1) * size) < 0) c++;
+    if (cmp(t + i * size, t + c * size) >= 0) return;
+    swap_bytes(t + i * size, t + c * size, size);
+    i = c;
+  }
+}
+
+// Heapsort, unlike qsort guaranteed not to allocate
+static void heap_sort(uint8_t *t, size_t nitems, size_t size,
+                      int (*cmp)(const void *, const void *)) {
+  for (size_t i = nitems / 2; i-- > 0;) sift_down(t, i, nitems, size, cmp);
+  for (size_t n = nitems - 1; n > 0; n--) {
+    swap_bytes(t, t + n * size, size);
+    sift_down(t, 0, n, size, cmp);
+  }
+}
+
+// Sorts in place, then keeps the first element of every run of equal elements
 int myriota_sort_unique(void *base, size_t nitems, size_t size,
                         int (*cmp)(const void *, const void *)) {
   if (base == NULL) return 0;
   if (nitems == 0) return 0;
-  uint8_t t[size * nitems];
-  memcpy(t, base, size * nitems);
-  qsort(t, nitems, size, cmp);
-  int c = 1;
-  memcpy(base, t, size);  // first element is unique
+  uint8_t *t = (uint8_t *)base;
+  heap_sort(t, nitems, size, cmp);
+  size_t c = 1;  // first element is unique
   for (size_t i = 1; i < nitems; i++) {
-    if (cmp(t + (i - 1) * size, t + i * size) == 0) continue;
-    memcpy(base + c * size, t + i * size, size);
+    if (cmp(t + (c - 1) * size, t + i * size) == 0) continue;
+    if (c != i) memcpy(t + c * size, t + i * size, size);
     c++;
   }
   return c;
 }
+
+// Defines the integer sort_unique functions. Least significant digit first
+// radix sort with 8 bit digits, ping-ponging between a and the scratch
+// buffer. Each digit is counted just before it is distributed, so only one
+// histogram is on the stack, and digits that are the same for all keys are
+// skipped, so for example timestamps sharing their high bytes take fewer
+// passes. The sign bit of signed keys is flipped so that they order as
+// unsigned. Duplicates are removed while copying the sorted keys back into a.
+#define define_sort_unique(name, type, utype, sign, cmp)                      \
+  int name(type *a, size_t nitems, type *scratch) {                           \
+    if (a == NULL || nitems == 0) return 0;                                   \
+    type *allocated = NULL;                                                   \
+    if (scratch == NULL) {                                                    \
+      scratch = allocated = (type *)malloc(sizeof(type) * nitems);            \
+      if (scratch == NULL) /* fall back to sorting in place */                \
+        return myriota_sort_unique(a, nitems, sizeof(type), cmp);             \
+    }                                                                         \
+    type *from = a, *to = scratch;                                            \
+    for (int d = 0; d < (int)sizeof(type); d++) {                             \
+      size_t count[256] = {0};                                                \
+      for (size_t i = 0; i < nitems; i++)                                     \
+        count[(((utype)from[i] ^ (sign)) >> (8 * d)) & 0xff]++;               \
+      const utype k0 = ((utype)from[0] ^ (sign));                             \
+      if (count[(k0 >> (8 * d)) & 0xff] == nitems) continue;                  \
+      size_t offset = 0;                                                      \
+      for (int b = 0; b < 256; b++) {                                         \
+        const size_t c = count[b];                                            \
+        count[b] = offset;                                                    \
+        offset += c;                                                          \
+      }                                                                       \
+      for (size_t i = 0; i < nitems; i++) {                                   \
+        const utype k = (utype)from[i] ^ (sign);                              \
+        to[count[(k >> (8 * d)) & 0xff]++] = from[i];                         \
+      }                                                                       \
+      type *const t = from;                                                   \
+      from = to;                                                              \
+      to = t;                                                                 \
+    }                                                                         \
+    size_t c = 1;                                                             \
+    a[0] = from[0];                                                           \
+    for (size_t i = 1; i < nitems; i++)                                       \
+      if (from[i] != a[c - 1]) a[c++] = from[i];                              \
+    free(allocated);                                                          \
+    return c;                                                                 \
+  }
+
+static int cmp_uint32(const void *ap, const void *bp) {
+  const uint32_t a = *(const uint32_t *)ap;
+  const uint32_t b = *(const uint32_t *)bp;
+  return (a > b) - (a < b);
+}
+
+static int cmp_uint64(const void *ap, const void *bp) {
+  const uint64_t a = *(const uint64_t *)ap;
+  const uint64_t b = *(const uint64_t *)bp;
+  return (a > b) - (a < b);
+}
+
+static int cmp_int64(const void *ap, const void *bp) {
+  const int64_t a = *(const int64_t *)ap;
+  const int64_t b = *(const int64_t *)bp;
+  return (a > b) - (a < b);
+}
+
+define_sort_unique(myriota_sort_unique_uint32, uint32_t, uint32_t, 0,
+                   cmp_uint32);
+define_sort_unique(myriota_sort_unique_int32, int32_t, uint32_t,
+                   UINT32_C(1) << 31, cmp_int32);
+define_sort_unique(myriota_sort_unique_uint64, uint64_t, uint64_t, 0,
+                   cmp_uint64);
+define_sort_unique(myriota_sort_unique_int64, int64_t, uint64_t,
+                   UINT64_C(1) << 63, cmp_int64);
@@ -12,6 +12,7 @@
 // limitations under the License.
 
 #include "math/myriotamath.h"
+#include <algorithm>
 
 namespace myriota {
 
@@ -24,53 +25,201 @@ static double blackman(double t, double W) {
 
 static double h(double t, double W) { return myriota_sinc(t) * blackman(t, W); }
 
-Upsampler::Upsampler(double in_rate, double out_rate, double W)
+// Resampling filter g(i) = h(i / s, W) for ceil(-s * W) <= i <= floor(s * W)
+static std::vector<double> resampling_filter(int64_t s, double W) {
+  std::vector<double> g;
+  for (int64_t n = ceil(-s * W); n <= floor(s * W); n++) {
+    const double t = (1.0 * n) / s;
+    g.push_back(h(t, W));
+  }
+  return g;
+}
+
+// Floor and ceiling of a / b for integer a and positive integer b
+static int64_t floor_div(int64_t a, int64_t b) { return a / b - (a % b < 0); }
+static int64_t ceil_div(int64_t a, int64_t b) { return -floor_div(-a, b); }
+
+static inline std::complex<double> dot(const std::complex<double> *x,
+                                       const double *h, size_t n) {
+  double y[2];
+  myriota_complex_real_dot(reinterpret_cast<const double *>(x), h, n, y);
+  return std::complex<double>(y[0], y[1]);
+}
+
+static inline std::complex<float> dot(const std::complex<float> *x,
+                                      const float *h, size_t n) {
+  float y[2];
+  myriota_complex_real_dot_float(reinterpret_cast<const float *>(x), h, n, y);
+  return std::complex<float>(y[0], y[1]);
+}
+
+template <typename T>
+BasicPolyphaseFilter<T>::BasicPolyphaseFilter(const std::vector<double> &g,
+                                              int gmin, int p)
+    : gmin(gmin), gmax(gmin + g.size() - 1), p(p), stride(0), length(p) {
+  for (int r = 0; r < p; r++) {
+    length[r] = gmax - gmin >= r ? (gmax - gmin - r) / p + 1 : 0;
+    stride = std::max(stride, length[r]);
+  }
+  buf.assign(p * stride, 0.0);
+  for (int r = 0; r < p; r++)
+    for (unsigned int t = 0; t < length[r]; t++)
+      buf[r * stride + t] = g[gmax - r - p * t - gmin];
+}
+
+template <typename T>
+BasicUpsampler<T>::BasicUpsampler(double in_rate, double out_rate, double W)
     : W(W),
       r(myriota_rational_approximation(out_rate / in_rate, 1e-6, 1000, 10)),
       gamma((1.0 * r.p) / r.q),
       gmin(ceil(-r.p * W)),
       gmax(floor(r.p * W)),
-      a(ceil(2 * W + 1), 0.0) {
+      a(ceil(2 * W + 1), 0.0),
+      g_buf(resampling_filter(r.p, W)),
+      filter(g_buf, gmin, r.p) {
   if (r.p < r.q) throw std::invalid_argument("must have in_rate <= out_rate");
-
-  // fill resampling filter buffer
-  for (int n = gmin; n <= gmax; n++) {
-    const double t = (1.0 * n) / r.p;
-    g_buf.push_back(h(t, W));
-  }
 }
 
-complex Upsampler::operator()(int64_t n) const {
+template <typename T>
+std::complex<T> BasicUpsampler<T>::operator()(int64_t n) const {
   const double ng = n / gamma;
   const int64_t U = floor(ng + W);
-  const int64_t L = ceil(ng - W);
-  complex sum = 0;
-  for (int64_t m = L; m <= U; m++) sum += a(m) * g(r.q * n - r.p * m);
-  return sum;
+  int64_t L = ceil(ng - W);
+  // Input m is weighted by g(r.q * n - r.p * m), these taps are contiguous
+  int64_t i = r.q * n - r.p * L;
+  if (i > gmax) {
+    const int64_t skip = ceil_div(i - gmax, r.p);
+    L += skip;
+    i -= skip * r.p;
+  }
+  if (L > U) return 0;
+  unsigned int size;
+  const T *taps = filter.taps(i, size);
+  return dot(a.contiguous(L), taps, std::min<int64_t>(size, U - L + 1));
 }
 
-Downsampler::Downsampler(double in_rate, double out_rate, double W)
+template <typename T>
+BasicDownsampler<T>::BasicDownsampler(double in_rate, double out_rate,
+                                      double W)
     : W(W),
       r(myriota_rational_approximation(out_rate / in_rate, 1e-6, 1000, 10)),
       gamma((1.0 * r.p) / r.q),
       gmin(ceil(-r.q * W)),
       gmax(floor(r.q * W)),
-      a(ceil(2 * W / gamma + 1), 0.0) {
+      a(ceil(2 * W / gamma + 1), 0.0),
+      g_buf(resampling_filter(r.q, W)),
+      filter(g_buf, gmin, r.p) {
   if (r.p >= r.q) throw std::invalid_argument("must have in_rate > out_rate");
+}
 
-  // fill resampling filter buffer
-  for (int n = gmin; n <= gmax; n++) {
-    const double t = (1.0 * n) / r.q;
-    g_buf.push_back(h(t, W));
+template <typename T>
+std::complex<T> BasicDownsampler<T>::operator()(int64_t n) const {
+  const int64_t U = floor((n + W) / gamma);
+  int64_t L = ceil((n - W) / gamma);
+  // Input m is weighted by g(r.q * n - r.p * m), these taps are contiguous
+  int64_t i = r.q * n - r.p * L;
+  if (i > gmax) {
+    const int64_t skip = ceil_div(i - gmax, r.p);
+    L += skip;
+    i -= skip * r.p;
   }
+  if (L > U) return 0;
+  unsigned int size;
+  const T *taps = filter.taps(i, size);
+  return dot(a.contiguous(L), taps, std::min<int64_t>(size, U - L + 1)) *
+         T(gamma);
 }
 
-complex Downsampler::operator()(int64_t n) const {
-  const int64_t U = floor((n + W) / gamma);
-  const int64_t L = ceil((n - W) / gamma);
-  complex sum = 0;
-  for (int64_t m = L; m <= U; m++) sum += a(m) * g(r.q * n - r.p * m);
-  return sum * gamma;
+// Scale of the resampling filter, see resampling_filter
+static int64_t filter_scale(myriota_rational r) {
+  return r.p >= r.q ? r.p : r.q;
 }
 
+template <typename T>
+BasicPolyphaseResampler<T>::BasicPolyphaseResampler(double in_rate,
+                                                    double out_rate, double W)
+    : W(W),
+      r(myriota_rational_approximation(out_rate / in_rate, 1e-6, 1000, 10)),
+      gamma((1.0 * r.p) / r.q),
+      upsampling(r.p >= r.q),
+      filter(resampling_filter(filter_scale(r), W),
+             ceil(-filter_scale(r) * W), r.p),
+      lead(r.p),
+      maxlead(0),
+      N(0),
+      n(0),
+      k(0),
+      phase(0) {
+  // Writing r.q * n = k * r.p + phase, output n uses g(phase + r.p * j) on
+  // input k - j for those j with gmin <= phase + r.p * j <= gmax. The taps of
+  // a phase start from the largest such j.
+  for (int64_t i = 0; i < r.p; i++) {
+    lead[i] = floor_div(filter.gmax - i, r.p);
+    maxlead = std::max(maxlead, lead[i]);
+  }
+
+  // Input samples before the first are zero
+  base = -maxlead;
+  history.assign(maxlead, 0.0);
+}
+
+template <typename T>
+int64_t BasicPolyphaseResampler<T>::maxn(int64_t pushed) const {
+  if (upsampling) return floor(gamma * (pushed - 2 - W));
+  return floor(gamma * (pushed - 2) - W);
+}
+
+template <typename T>
+size_t BasicPolyphaseResampler<T>::max_output(size_t n_in) const {
+  return std::max<int64_t>(maxn(N + n_in) - n + 1, 0);
+}
+
+template <typename T>
+size_t BasicPolyphaseResampler<T>::process(const sample *in, size_t n_in,
+                                           sample *out) {
+  history.insert(history.end(), in, in + n_in);
+  N += n_in;
+
+  const int64_t nmax = maxn(N);
+  const int64_t kstep = r.q / r.p;
+  const int64_t phasestep = r.q % r.p;
+  const T scale = upsampling ? 1 : gamma;
+  size_t written = 0;
+  while (n <= nmax) {
+    const int64_t first = k - lead[phase];
+    unsigned int size;
+    const T *taps = filter.taps(phase + r.p * lead[phase], size);
+    if (first + size > N) break;  // wait for more input
+    const sample sum = dot(&history[first - base], taps, size);
+    out[written++] = upsampling ? sum : sum * scale;
+
+    n++;
+    k += kstep;
+    phase += phasestep;
+    if (phase >= r.p) {
+      phase -= r.p;
+      k++;
+    }
+  }
+
+  // Drop input samples no longer required once they make up more than half
+  // of the history, so the cost of the move is amortised over many samples.
+  const int64_t drop = std::min(k - maxlead, N) - base;
+  if (drop > 0 && 2 * drop > (int64_t)history.size()) {
+    history.erase(history.begin(), history.begin() + drop);
+    base += drop;
+  }
+
+  return written;
+}
+
+template class BasicPolyphaseFilter<float>;
+template class BasicPolyphaseFilter<double>;
+template class BasicUpsampler<float>;
+template class BasicUpsampler<double>;
+template class BasicDownsampler<float>;
+template class BasicDownsampler<double>;
+template class BasicPolyphaseResampler<float>;
+template class BasicPolyphaseResampler<double>;
+
 }  // namespace myriota
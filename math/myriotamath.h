@@ -119,6 +119,64 @@ void myriota_write_bits(const uint8_t *from, uint8_t *to,
 void myriota_read_bits(const uint8_t *from, uint8_t *to,
                        const unsigned int start, const unsigned int stop);
 
+// Bit writer and reader using the bit order of myriota_get_bit, i.e. bit n is
+// bit 7 - n % 8 of byte n / 8, with multi-bit values most significant bit
+// first. Bits are accumulated in a 64 bit word so that a field costs a few
+// shifts rather than a call per bit, and fields may start at any bit offset.
+typedef struct {
+  uint8_t *data;
+  size_t byte;           // next byte of data to be written
+  uint64_t accumulator;  // the low pending bits are not yet written
+  unsigned int pending;  // number of bits in the accumulator
+} myriota_bit_writer;
+
+// Start writing at bit start of data. Bits before start are preserved.
+void myriota_bit_writer_init(myriota_bit_writer *w, void *data, size_t start);
+
+// Append the low bits (at most 64) of value.
+void myriota_bit_writer_write(myriota_bit_writer *w, uint64_t value,
+                              unsigned int bits);
+
+// Write out pending bits. A final partial byte keeps its bits past the end of
+// the written bits. Writing may continue after a flush.
+void myriota_bit_writer_flush(myriota_bit_writer *w);
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;      // bytes in data
+  size_t position;  // bit offset of the next bit to be read
+} myriota_bit_reader;
+
+// Start reading at bit start of the size bytes in data.
+void myriota_bit_reader_init(myriota_bit_reader *r, const void *data,
+                             size_t size, size_t start);
+
+// Read the next bits (at most 64) as an unsigned integer. Bits past the
+// end of data read as zero.
+uint64_t myriota_bit_reader_read(myriota_bit_reader *r, unsigned int bits);
+
+// A field of a fixed layout message and the column it is unpacked into
+typedef struct {
+  size_t offset;       // bit offset of the field in each message
+  unsigned int bits;   // width of the field, 1 to 64
+  bool is_signed;      // two's complement, sign extended into the column
+  bool little_endian;  // whole bytes in little endian order, as in packed
+                       // structs on the module, otherwise most significant
+                       // bit first
+  void *column;        // one value per message
+  unsigned int column_size;  // bytes per value, 1, 2, 4 or 8
+} myriota_bit_field;
+
+// Unpacks count messages of message_size bytes, stored one after another,
+// into struct-of-arrays columns, i.e. field f of message m is written to
+// element m of fields[f].column. Values too wide for the column are
+// truncated. Returns 0 on success and -1, without unpacking anything, if a
+// field extends past the end of a message, has an invalid width or column
+// size, or is little endian but not a whole number of bytes.
+int myriota_unpack_bit_fields(const void *messages, size_t message_size,
+                              size_t count, const myriota_bit_field *fields,
+                              size_t n_fields);
+
 // Returns a complex number from rectangular coordinates, i.e.
 // from real and imaginary parts.
 myriota_complex myriota_rectangular(myriota_decimal re, myriota_decimal im);
@@ -129,6 +187,25 @@ myriota_complex myriota_polar(myriota_decimal magnitude, myriota_decimal phase);
 // Norm (magnitude squared) of a complex number
 myriota_decimal myriota_complex_norm(myriota_complex x);
 
+// Dot product of n complex samples x with n real taps h. The samples are
+// interleaved real and imaginary parts, that is, x has length 2n. The real and
+// imaginary parts of the result are written into y[0] and y[1].
+//
+// Uses AVX-512, AVX2 or NEON instructions when available. On x86 the
+// instruction set is detected at runtime.
+void myriota_complex_real_dot(const double *x, const double *h, size_t n,
+                              double *y);
+void myriota_complex_real_dot_float(const float *x, const float *h, size_t n,
+                                    float *y);
+
+// Adds a[0] times row 0 of x, then a[1] times row 1 and so on up to row
+// rows - 1, to the n elements of y. Row j of x starts at x + j * ldx. The
+// terms are added to each element in order, as by a scalar loop, and
+// multiplies are not fused, so results do not depend on the instruction set.
+// This is the inner kernel of myriota_matrix_multiply.
+void myriota_axpy_rows(size_t rows, const double *a, const double *x,
+                       size_t ldx, size_t n, double *y);
+
 // Sinc function
 double myriota_sinc(double t);
 
@@ -176,6 +253,13 @@ int myriota_base64_to_buf(const char *s, void *buf);
 // Returns the number of bytes written to buf
 int myriota_n_base64_to_buf(const char *s, const size_t n, void *buf);
 
+// Decodes the longest prefix of the n base64 characters s made of whole
+// vector blocks without invalid characters, writing 3 bytes to buf for every
+// 4 characters. Returns the number of characters decoded, a multiple of 4,
+// which is always zero when SSSE3 or NEON instructions are not available.
+// myriota_n_base64_to_buf decodes the remainder.
+size_t myriota_base64_decode_blocks(const char *s, size_t n, uint8_t *buf);
+
 // Writes buffer in base64 format to string. s should be allocated with size at
 // least buf_size*4/3+1. buf_size must be a multiple of 3. Returns number of
 // hexidecimal characters written.
@@ -398,14 +482,41 @@ void myriota_rotate(int *array, int size, int n);
 // r is now {1,1,0,0,1,0,1}
 void myriota_msequence(const int N, int *r);
 
-// Return the kth largest element from the array of size nitems
+// Return the kth smallest element, counting from zero, from the array of size
+// nitems. The array is reordered so that the returned element is at a[k],
+// with smaller or equal elements before it and larger or equal elements
+// after. Takes linear time.
 double myriota_select_double(const int k, double *a, const size_t nitems);
 int32_t myriota_select_int32(const int k, int32_t *a, const size_t nitems);
 
-// Returns the median of an array of size nitems
+// Returns the median of an array of size nitems, reordering it as
+// myriota_select_double does. Takes linear time.
 double myriota_median_double(double *a, const size_t nitems);
 int32_t myriota_median_int32(int32_t *a, const size_t nitems);
 
+// Median of the most recent window samples of a stream, for example to track
+// a noise floor. Each push takes O(log window) time and no memory is
+// allocated after creation.
+typedef struct myriota_running_median myriota_running_median;
+
+// Returns NULL if window is zero or memory allocation fails. Free with
+// myriota_running_median_destroy.
+myriota_running_median *myriota_running_median_create(
+    const unsigned int window);
+
+// Does nothing for NULL.
+void myriota_running_median_destroy(myriota_running_median *m);
+
+// Removes all samples.
+void myriota_running_median_reset(myriota_running_median *m);
+
+// Adds sample x, dropping the oldest sample once the window is full. Returns
+// the median of the samples in the window.
+double myriota_running_median_push(myriota_running_median *m, const double x);
+
+// Median of the samples in the window, zero if there are none.
+double myriota_running_median_value(const myriota_running_median *m);
+
 // Returns the discrete Fourier transform of a complex array of length N
 // at frequency f in cycles per sample
 //
@@ -421,21 +532,63 @@ myriota_complex myriota_discrete_fourier_transform(const unsigned int N,
                                                    const myriota_complex *in,
                                                    const myriota_decimal f);
 
+// Precomputed plan for fast Fourier transforms of length N. Creating a plan
+// computes the bit reversal permutation and twiddle factors once, so that
+// repeated transforms of the same length only do the butterflies.
+//
+// Powers of two use radix-4 stages (with one radix-2 stage when log2(N) is
+// odd). Other lengths use Bluestein's algorithm, a convolution computed with
+// a power of two plan of length at least 2N - 1.
+//
+// A plan holds scratch memory, so it must not be executed by more than one
+// thread at a time. Create one plan per thread instead.
+typedef struct myriota_fft_plan myriota_fft_plan;
+
+// Creates a plan for transforms of length N. Returns NULL if N is zero or
+// memory allocation fails. Free with myriota_fft_plan_destroy.
+myriota_fft_plan *myriota_fft_plan_create(const unsigned int N);
+
+// Frees a plan created by myriota_fft_plan_create. Does nothing for NULL.
+void myriota_fft_plan_destroy(myriota_fft_plan *plan);
+
+// Transform length of the plan
+unsigned int myriota_fft_plan_length(const myriota_fft_plan *plan);
+
+// Computes the fast Fourier transform of the complex array in of the plan
+// length and returns the result into complex array out.
+//
+// This implementation works inplace by setting out == in.
+void myriota_fft_execute(myriota_fft_plan *plan, const myriota_complex *in,
+                         myriota_complex *out);
+
+// Computes the inverse fast Fourier transform, including the scaling by
+// 1 / N, of the complex array in of the plan length and returns the result
+// into complex array out.
+//
+// This implementation works inplace by setting out == in.
+void myriota_inverse_fft_execute(myriota_fft_plan *plan,
+                                 const myriota_complex *in,
+                                 myriota_complex *out);
+
 // Computes the fast Fourier transform of the complex array of length N and
-// returns result into complex array out. N must be a power of 2.
+// returns result into complex array out. N need not be a power of 2, but
+// powers of 2 are fastest.
 //
-// Cooley-Tukey radix-2 decimation in time implementation. Input arrays must be
-// zero padded to length a power of 2.
+// Powers of 2 are computed in place without allocating memory. Other lengths
+// create a temporary plan, see myriota_fft_plan_create. Use a plan directly
+// when computing many transforms of the same length.
 //
 // This implementation works inplace by setting out == in.
 void myriota_fft(const unsigned int N, const myriota_complex *in,
                  myriota_complex *out);
 
 // Computes the inverse fast Fourier transform of the complex array of length N
-// and returns result into complex array out. N must be a power of 2.
+// and returns result into complex array out. N need not be a power of 2, but
+// powers of 2 are fastest.
 //
-// Cooley-Tukey radix-2 decimation in time implementation. Input arrays must be
-// zero padded to length a power of 2.
+// Powers of 2 are computed in place without allocating memory. Other lengths
+// create a temporary plan, see myriota_fft_plan_create. Use a plan directly
+// when computing many transforms of the same length.
 //
 // This implementation works inplace by setting out == in.
 void myriota_inverse_fft(const unsigned int N, const myriota_complex *in,
@@ -457,6 +610,35 @@ void myriota_detect_sinusoid_inplace(myriota_complex *x, const unsigned int N,
                                      myriota_decimal *residual_variance,
                                      myriota_decimal *confidence);
 
+// Sinusoid estimates, see myriota_detect_sinusoid_inplace
+typedef struct {
+  myriota_decimal frequency;
+  myriota_complex amplitude;
+  myriota_decimal residual_variance;
+  myriota_decimal confidence;
+} myriota_sinusoid;
+
+// Detect a sinusoid in each of count windows of length N, window w being
+// x[w * hop], ..., x[w * hop + N - 1]. Windows overlap when hop < N. Results
+// are written to result[w] and, when neighbourhood is zero, agree with
+// myriota_detect_sinusoid_inplace on the zero padded window up to the
+// tolerance of the Brent refinement. The input x is not modified.
+//
+// If neighbourhood is positive the Brent refinement evaluates the periodogram
+// from the 2 * neighbourhood + 1 FFT bins nearest the peak instead of from all
+// N time domain samples. This is faster for long windows and approximate, a
+// neighbourhood of 8 to 16 bins is usually accurate to a small fraction of a
+// bin.
+//
+// Each thread uses one FFT plan and one scratch buffer for all its windows.
+// Windows are divided between up to threads threads on POSIX hosts, other
+// platforms always use one thread. Returns 0 on success and -1 if N is zero
+// or memory allocation fails.
+int myriota_detect_sinusoids(const myriota_complex *x, const unsigned int N,
+                             const unsigned int hop, const unsigned int count,
+                             const unsigned int neighbourhood,
+                             unsigned int threads, myriota_sinusoid *result);
+
 // Multiply MxN matrix A by N by K matrix B producing M by K matrix X.
 // Matrices are assumed flattened rowise, that is, one row after the next.
 void myriota_matrix_multiply(const int M, const int N, const int K,
@@ -481,11 +663,61 @@ int myriota_matrix_lu(const int M, const int N, const double *A, double *L,
 
 void myriota_matrix_print(const int M, const int N, const double *A, FILE *f);
 
+// Cholesky decomposition of symmetric positive definite N by N matrix A in
+// place, A = L L^T. The lower triangle of A is overwritten by L and the upper
+// triangle set to zero. Returns -1 if A is not positive definite and 0 on
+// success.
+int myriota_matrix_cholesky(const int N, double *A);
+
+// Overwrites N by K matrix Y with X such that L L^T X = Y, where L is a
+// Cholesky factor from myriota_matrix_cholesky.
+void myriota_matrix_cholesky_solve(const int N, const int K, const double *L,
+                                   double *Y);
+
+// Least squares solution X of AX = Y for M by N matrix A, M >= N, and M by K
+// matrix Y, by Householder QR decomposition in place. This avoids the
+// squared condition number of the normal equations. A is overwritten and the
+// N by K solution is written into the first N rows of Y. Returns -1 if M < N
+// or A does not have full column rank and 0 on success.
+int myriota_matrix_least_squares(const int M, const int N, const int K,
+                                 double *A, double *Y);
+
 // Least sequare fit polynomial a[0] + a[1] t + a[2] t^2 + ... a[r-1] t^r of
-// order r to data x. Both tand x assumed to be arrays of length N.
+// order r to data x. Both tand x assumed to be arrays of length N. Orders up
+// to MYRIOTA_POLYFIT_MAX_ORDER are fitted in constant memory. Higher orders,
+// and fits too ill conditioned for that, fall back to QR decomposition of all
+// N samples, allocating O(N r) memory on the heap. a is left unchanged if the
+// fit is not unique, e.g. if N <= r, or the allocation fails.
 void myriota_polyfit(const double *t, const double *x, const int N, const int r,
                      double *a);
 
+// Streaming least squares polynomial fit. Samples are added one at a time and
+// only the sums that make up the normal equations are kept, so memory does
+// not grow with the number of samples. Time is measured from the first
+// sample, u = t - t0, so the sums stay well conditioned for long series with
+// large timestamps.
+#define MYRIOTA_POLYFIT_MAX_ORDER 15
+typedef struct {
+  int r;                                        // order
+  unsigned long n;                              // samples added
+  double t0;                                    // time of the first sample
+  double S[2 * MYRIOTA_POLYFIT_MAX_ORDER + 1];  // sum of u^k
+  double Sx[MYRIOTA_POLYFIT_MAX_ORDER + 1];     // sum of u^k x
+} myriota_polyfit_state;
+
+// Start a fit of order r. Returns -1 if r is negative or larger than
+// MYRIOTA_POLYFIT_MAX_ORDER and 0 on success.
+int myriota_polyfit_init(myriota_polyfit_state *p, const int r);
+
+// Add the sample x at time t.
+void myriota_polyfit_add(myriota_polyfit_state *p, const double t,
+                         const double x);
+
+// Write the r + 1 coefficients of the polynomial fitted to the samples added
+// so far into a, as for myriota_polyfit. Returns -1, leaving a unchanged, if
+// the fit is not unique and 0 on success.
+int myriota_polyfit_solve(const myriota_polyfit_state *p, double *a);
+
 // Generic function for type, length, value data structures. These functions
 // require two functions, int size(void*) that returns the size (or length) in
 // bytes of an element, and int end(void*) that write a terminating value and
@@ -532,16 +764,144 @@ void *myriota_tlv_get_find(int i, const void *tlv,
 int myriota_tlv_filter(const void *tlv, unsigned int (*size)(const void *),
                        bool (*f)(const void *, void *), void *f_state,
                        const void *x[]);
+// Side index of a type, length, value sequence, giving constant time access to
+// the ith element, count and total size. The offsets of the elements are
+// kept in an array and updated by the myriota_tlv_index functions, so the
+// sequence must only be modified through them while the index is in use. As
+// for myriota_tlv_append, the buffer holding the sequence must have room for
+// appended elements.
+//
+// The functions above take only a pointer to the sequence, with nowhere to
+// keep an index, and their signatures are used by existing applications, so
+// the index is a parallel family of functions rather than a change to them.
+// Those functions still walk the sequence on every call; use these when
+// building or querying a long sequence.
+typedef struct {
+  void *tlv;
+  unsigned int (*size)(const void *);
+  int (*end)(void *);
+  unsigned int *offset;   // byte offset of each element from tlv
+  unsigned int count;     // number of elements
+  unsigned int capacity;  // allocated length of offset
+  unsigned int total;     // bytes in all elements, excluding the terminator
+} myriota_tlv_index;
+
+// Build the index of an existing sequence with a single pass. Returns -1 if
+// tlv is NULL or memory allocation fails, 0 on success.
+int myriota_tlv_index_init(myriota_tlv_index *x, void *tlv,
+                           unsigned int (*size)(const void *),
+                           int (*end)(void *));
+
+// Frees the offsets. The sequence itself is untouched.
+void myriota_tlv_index_free(myriota_tlv_index *x);
+
+// Get the ith element. Returns NULL if out of bounds.
+void *myriota_tlv_index_get(const myriota_tlv_index *x, const unsigned int i);
+
+// Append an element in amortised constant time. Returns -1 on fail, 0 on
+// success.
+int myriota_tlv_index_append(myriota_tlv_index *x, const void *a);
+
+// Delete the ith element. Returns -1 if out of bounds, 0 on success.
+int myriota_tlv_index_delete(myriota_tlv_index *x, const unsigned int i);
+
+// Count the number of elements that satisfy a boolean valued function, as
+// myriota_tlv_count_find without walking the sequence.
+unsigned int myriota_tlv_index_count_find(const myriota_tlv_index *x,
+                                          bool (*find)(const void *, void *),
+                                          void *find_state);
+
+// Find ith element satisfying boolean function, as myriota_tlv_get_find
+// without walking the sequence. Returns NULL if the element cannot be found.
+void *myriota_tlv_index_get_find(const myriota_tlv_index *x, int i,
+                                 bool (*find)(const void *, void *),
+                                 void *find_state);
+
+// Delete every element satisfying boolean function f, moving each remaining
+// byte at most once. Returns the number of elements deleted.
+unsigned int myriota_tlv_index_delete_find(myriota_tlv_index *x,
+                                           bool (*f)(const void *, void *),
+                                           void *f_state);
+
 // Read tlv structure from file. If the file ends before the terminating value
-// is reached, then the terminating value is added.
+// is reached, then the terminating value is added. Element sizes are not known
+// here, so it is added straight after the last byte read, following any
+// partial element at the end of a truncated file, unlike
+// myriota_tlv_map_file and myriota_tlv_stream, which stop at the last whole
+// element. Use those for files that may be truncated.
 // Returns malloc'd structure than must be freed by the caller.
 void *myriota_tlv_from_file(FILE *f, int (*end)(void *));
 
+#if defined(__unix__)
+// Read-only view of a tlv structure in a memory mapped file
+typedef struct {
+  const void *tlv;  // start of the structure
+  size_t size;      // bytes up to and including the terminating value
+  void *base;       // start of the mapping
+  size_t length;    // bytes mapped
+} myriota_tlv_map;
+
+// Map a file of tlv structure into memory without copying it. If the file
+// ends before the terminating value is reached, then the terminating value is
+// added by end() behind the last whole element, in a private copy of that page
+// only, so the file and the rest of the mapping are never written. Any partial
+// element at the end of a truncated file is dropped, whereas
+// myriota_tlv_from_file keeps its bytes ahead of the terminating value.
+// Returns -1 on fail, 0 on success. The mapping must be released with
+// myriota_tlv_unmap_file.
+int myriota_tlv_map_file(const char *path, unsigned int (*size)(const void *),
+                         int (*end)(void *), myriota_tlv_map *m);
+
+void myriota_tlv_unmap_file(myriota_tlv_map *m);
+#endif
+
+// Iterator over a tlv structure in a file that is read through a fixed buffer,
+// for files too large to hold in memory
+typedef struct {
+  FILE *f;
+  unsigned int (*size)(const void *);
+  int (*end)(void *);
+  uint8_t *buf;
+  size_t capacity;  // bytes of buf for file data
+  size_t max_size;  // size of the largest element
+  size_t position;  // offset in buf of the next element
+  size_t fill;      // bytes of file data in buf
+  bool eof;
+} myriota_tlv_stream;
+
+// Prepare to read elements no larger than max_size bytes from f, which is not
+// closed by the stream. Returns -1 on fail, 0 on success.
+int myriota_tlv_stream_init(myriota_tlv_stream *s, FILE *f,
+                            unsigned int (*size)(const void *),
+                            int (*end)(void *), const size_t max_size);
+
+void myriota_tlv_stream_free(myriota_tlv_stream *s);
+
+// Returns the next element, or NULL at the terminating value or end of file.
+// The element is valid until the next call on the stream.
+const void *myriota_tlv_stream_next(myriota_tlv_stream *s);
+
+// Returns the next element satisfying boolean function f, or NULL if no such
+// element. The element is valid until the next call on the stream.
+const void *myriota_tlv_stream_find(myriota_tlv_stream *s,
+                                    bool (*f)(const void *, void *),
+                                    void *f_state);
+
 // Like standard qsort but also removes duplicates. Returns the number of unique
-// elements.
+// elements. Sorts in place by heapsort without allocating memory.
 int myriota_sort_unique(void *base, size_t nitems, size_t size,
                         int (*compar)(const void *, const void *));
 
+// Like myriota_sort_unique for integer keys, using radix sort, which is much
+// faster for large arrays. scratch must have room for nitems elements, or be
+// NULL to allocate it for the call. If that allocation fails the array is
+// sorted in place by myriota_sort_unique instead. Uses 256 size_t counts of
+// stack.
+int myriota_sort_unique_uint32(uint32_t *a, size_t nitems, uint32_t *scratch);
+int myriota_sort_unique_int32(int32_t *a, size_t nitems, int32_t *scratch);
+int myriota_sort_unique_uint64(uint64_t *a, size_t nitems, uint64_t *scratch);
+int myriota_sort_unique_int64(int64_t *a, size_t nitems, int64_t *scratch);
+
 #ifdef __cplusplus
 }
 
@@ -559,7 +919,9 @@ typedef std::complex<decimal> complex;
 //
 // Internally, the size of the buffer is always increased to the power
 // of 2 greater than or equal to the requested size. This allows faster
-// mod size operations (bitwise AND).
+// mod size operations (bitwise AND). Each element is stored twice, size
+// elements apart, so that any size consecutive elements are also stored
+// contiguously in memory.
 template <typename T>
 class CircularBuffer {
  public:
@@ -571,12 +933,13 @@ class CircularBuffer {
   CircularBuffer(unsigned int size, T init)
       : size(myriota_greater_power_of_two(size + 1)),
         mask(this->size - 1),
-        buf(this->size, init),
+        buf(2 * this->size, init),
         N(0){};
 
   // Write/push an element to the end of the buffer
   inline void push(const T &elem) {
     buf[N & mask] = elem;
+    buf[(N & mask) + size] = elem;
     N++;
   }
 
@@ -590,6 +953,10 @@ class CircularBuffer {
   // Read the nth element of the buffer
   inline const T &operator()(const int64_t n) const { return buf[n & mask]; }
 
+  // Pointer p to the nth element of the buffer such that p[i] == (*this)(n + i)
+  // for 0 <= i < size.
+  inline const T *contiguous(const int64_t n) const { return &buf[n & mask]; }
+
   // Read the nth element of the buffer after index validation. Throws
   // std::out_of_range if the requested element hasn't been pushed yet or
   // is no longer in the buffer. Analogous to std::vector::at.
@@ -601,9 +968,10 @@ class CircularBuffer {
   }
 
   void set(const int64_t n, const T &v) {
-    if (n >= minn() && n <= maxn())
+    if (n >= minn() && n <= maxn()) {
       buf[n & mask] = v;
-    else
+      buf[(n & mask) + size] = v;
+    } else
       throw std::out_of_range("circluar buffer set " + std::to_string(n) +
                               " outside [" + std::to_string(minn()) + ", " +
                               std::to_string(maxn()) + "]");
@@ -614,50 +982,139 @@ class CircularBuffer {
   uint64_t N;
 };
 
+// Resampling filter g(i), gmin <= i <= gmax, rearranged into p rows for
+// polyphase filtering. Row r holds g(gmax - r), g(gmax - r - p),
+// g(gmax - r - 2p), ... contiguously, so every sequence g(i), g(i - p),
+// g(i - 2p), ... is stored contiguously in memory. Taps are stored with
+// the templated type T, either float or double.
+template <typename T>
+class BasicPolyphaseFilter {
+ public:
+  const int gmin;
+  const int gmax;
+  const int p;
+  BasicPolyphaseFilter(const std::vector<double> &g, int gmin, int p);
+  // Pointer to g(i), g(i - p), g(i - 2p), ... for gmin <= i <= gmax. The number
+  // of taps available from i down to gmin is written into size.
+  const T *taps(int64_t i, unsigned int &size) const {
+    const int64_t d = gmax - i;
+    size = length[d % p] - d / p;
+    return &buf[(d % p) * stride + d / p];
+  }
+
+ protected:
+  unsigned int stride;
+  std::vector<unsigned int> length;
+  std::vector<T> buf;
+};
+
+// The resampling classes below are templated on the precision T of the
+// samples and filter taps, either float or double. The filter is always
+// designed in double precision.
+
 // Upsample input sequence where in_rate <= out_rate
-class Upsampler {
+template <typename T>
+class BasicUpsampler {
  public:
+  typedef std::complex<T> sample;
   const double W;  // window width
   const myriota_rational r;
   const double gamma;
   const int gmin;
   const int gmax;
   // Widow width W can be adjusted, larger is slower, but more accurate
-  Upsampler(double in_rate, double out_rate, double W = 30);
-  void push(complex x) { a.push(x); };
+  BasicUpsampler(double in_rate, double out_rate, double W = 30);
+  void push(sample x) { a.push(x); };
   int64_t pushed() const { return a.pushed(); }
-  complex operator()(int64_t n) const;
+  sample operator()(int64_t n) const;
   int64_t minn() const { return ceil(gamma * (a.maxn() - a.size + W)); }
   int64_t maxn() const { return floor(gamma * (a.maxn() - 1 - W)); }
 
  protected:
-  CircularBuffer<complex> a;
+  CircularBuffer<sample> a;
   std::vector<double> g_buf;
   inline double g(int64_t n) const { return g_buf[n - gmin]; };
+  BasicPolyphaseFilter<T> filter;
 };
 
 // Downsample input sequence where in_rate > out_rate
-class Downsampler {
+template <typename T>
+class BasicDownsampler {
  public:
+  typedef std::complex<T> sample;
   const double W;  // window width
   const myriota_rational r;
   const double gamma;
   const int gmin;
   const int gmax;
   // Widow width W can be adjusted, larger is slower, but more accurate
-  Downsampler(double in_rate, double out_rate, double W = 30);
-  void push(complex x) { a.push(x); };
+  BasicDownsampler(double in_rate, double out_rate, double W = 30);
+  void push(sample x) { a.push(x); };
   int64_t pushed() const { return a.pushed(); }
-  complex operator()(int64_t n) const;
+  sample operator()(int64_t n) const;
   int64_t minn() const { return ceil(gamma * (a.maxn() - a.size) + W); }
   int64_t maxn() const { return floor(gamma * (a.maxn() - 1) - W); }
 
  protected:
-  CircularBuffer<complex> a;
+  CircularBuffer<sample> a;
   std::vector<double> g_buf;
   inline double g(int64_t n) const { return g_buf[n - gmin]; };
+  BasicPolyphaseFilter<T> filter;
+};
+
+// Polyphase resampler for block processing of an input sequence. Computes the
+// same output sequence as BasicUpsampler when in_rate <= out_rate and as
+// BasicDownsampler otherwise.
+//
+// The resampling filter is decomposed into r.p phases when the object is
+// built. The taps of each phase are stored contiguously in the order that
+// they are applied to the input, so each output sample is a dot product of
+// consecutive input samples with a single row of taps. Dot products use
+// myriota_complex_real_dot or myriota_complex_real_dot_float.
+template <typename T>
+class BasicPolyphaseResampler {
+ public:
+  typedef std::complex<T> sample;
+  const double W;  // window width
+  const myriota_rational r;
+  const double gamma;
+  // Widow width W can be adjusted, larger is slower, but more accurate
+  BasicPolyphaseResampler(double in_rate, double out_rate, double W = 30);
+
+  // Push n_in samples from in and write the output samples that become
+  // available into out. Returns the number of output samples written, which
+  // is at most max_output(n_in).
+  size_t process(const sample *in, size_t n_in, sample *out);
+
+  // Upper bound on the number of output samples written by process(in, n_in,
+  // out) in the current state.
+  size_t max_output(size_t n_in) const;
+
+  // The total number of input samples pushed and output samples produced
+  int64_t pushed() const { return N; }
+  int64_t produced() const { return n; }
+
+ protected:
+  const bool upsampling;
+  BasicPolyphaseFilter<T> filter;
+  std::vector<int64_t> lead;  // first input of phase s is k - lead[s]
+  int64_t maxlead;
+  std::vector<sample> history;  // input samples from index base onwards
+  int64_t base;
+  int64_t N;  // number of input samples pushed
+  int64_t n;  // index of the next output sample
+  // n * r.q = k * r.p + phase, the input sample and phase for output n
+  int64_t k;
+  int64_t phase;
+  int64_t maxn(int64_t pushed) const;
 };
 
+// Resampling classes with the default precision MYRIOTA_DECIMAL
+typedef BasicPolyphaseFilter<decimal> PolyphaseFilter;
+typedef BasicUpsampler<decimal> Upsampler;
+typedef BasicDownsampler<decimal> Downsampler;
+typedef BasicPolyphaseResampler<decimal> PolyphaseResampler;
+
 // Returns int x modulo int y, i.e., the coset representative from
 // {0,1,...,y-1} of x from the group Z/y.
 //
@@ -0,0 +1,600 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Vectorised kernels. Each kernel has a portable implementation and, where
+// available, implementations using SSSE3, AVX2, AVX-512 or NEON. On x86 the
+// instruction set is chosen at runtime so a single build runs on any CPU.
+
+#include "math/myriotamath.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MYRIOTA_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define MYRIOTA_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#define MYRIOTA_SIMD_ARM_CRC
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+// Slicing-by-8 needs 8KB of tables, microcontrollers use a single 1KB table
+#ifndef MYRIOTA_CRC32_SLICES
+#if defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_7M__) || \
+    defined(__ARM_ARCH_7EM__)
+#define MYRIOTA_CRC32_SLICES 1
+#else
+#define MYRIOTA_CRC32_SLICES 8
+#endif
+#endif
+#include "math/myriotamath_crc32.h"
+
+typedef void (*complex_real_dot_fn)(const double *, const double *, size_t,
+                                    double *);
+typedef void (*complex_real_dot_float_fn)(const float *, const float *, size_t,
+                                          float *);
+
+static void complex_real_dot_generic(const double *x, const double *h,
+                                     size_t n, double *y) {
+  double re = 0, im = 0;
+  for (size_t i = 0; i < n; i++) {
+    re += x[2 * i] * h[i];
+    im += x[2 * i + 1] * h[i];
+  }
+  y[0] = re;
+  y[1] = im;
+}
+
+static void complex_real_dot_float_generic(const float *x, const float *h,
+                                           size_t n, float *y) {
+  float re = 0, im = 0;
+  for (size_t i = 0; i < n; i++) {
+    re += x[2 * i] * h[i];
+    im += x[2 * i + 1] * h[i];
+  }
+  y[0] = re;
+  y[1] = im;
+}
+
+typedef void (*axpy_rows_fn)(size_t, const double *, const double *, size_t,
+                             size_t, double *);
+
+static void axpy_rows_generic(size_t rows, const double *a, const double *x,
+                              size_t ldx, size_t n, double *y) {
+  for (size_t k = 0; k < n; k++) {
+    double s = y[k];
+    for (size_t j = 0; j < rows; j++) s += a[j] * x[ldx * j + k];
+    y[k] = s;
+  }
+}
+
+#ifdef MYRIOTA_SIMD_X86
+
+// Each tap is duplicated so that it lines up with the real and imaginary
+// parts of the interleaved complex samples.
+
+__attribute__((target("avx2,fma"))) static void complex_real_dot_avx2(
+    const double *x, const double *h, size_t n, double *y) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256d h0 = _mm256_loadu_pd(h + i);
+    const __m256d h1 = _mm256_loadu_pd(h + i + 4);
+    // 0x50 selects taps {0, 0, 1, 1} and 0xfa selects taps {2, 2, 3, 3}
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + 2 * i),
+                         _mm256_permute4x64_pd(h0, 0x50), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + 2 * i + 4),
+                         _mm256_permute4x64_pd(h0, 0xfa), s1);
+    s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + 2 * i + 8),
+                         _mm256_permute4x64_pd(h1, 0x50), s2);
+    s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + 2 * i + 12),
+                         _mm256_permute4x64_pd(h1, 0xfa), s3);
+  }
+  const __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+  const __m128d t =
+      _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+  double r[2];
+  complex_real_dot_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = _mm_cvtsd_f64(t) + r[0];
+  y[1] = _mm_cvtsd_f64(_mm_unpackhi_pd(t, t)) + r[1];
+}
+
+__attribute__((target("avx2,fma"))) static void complex_real_dot_float_avx2(
+    const float *x, const float *h, size_t n, float *y) {
+  const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 h8 = _mm256_loadu_ps(h + i);
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + 2 * i),
+                         _mm256_permutevar8x32_ps(h8, lo), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + 2 * i + 8),
+                         _mm256_permutevar8x32_ps(h8, hi), s1);
+  }
+  const __m256 s = _mm256_add_ps(s0, s1);
+  __m128 t = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+  t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+  float r[2];
+  complex_real_dot_float_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = _mm_cvtss_f32(t) + r[0];
+  y[1] = _mm_cvtss_f32(_mm_shuffle_ps(t, t, 1)) + r[1];
+}
+
+__attribute__((target("avx512f"))) static void complex_real_dot_avx512(
+    const double *x, const double *h, size_t n, double *y) {
+  const __m512i lo = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+  const __m512i hi = _mm512_set_epi64(7, 7, 6, 6, 5, 5, 4, 4);
+  __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512d h8 = _mm512_loadu_pd(h + i);
+    s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + 2 * i),
+                         _mm512_permutexvar_pd(lo, h8), s0);
+    s1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + 2 * i + 8),
+                         _mm512_permutexvar_pd(hi, h8), s1);
+  }
+  const __m512d s = _mm512_add_pd(s0, s1);
+  const __m256d u =
+      _mm256_add_pd(_mm512_castpd512_pd256(s), _mm512_extractf64x4_pd(s, 1));
+  const __m128d t =
+      _mm_add_pd(_mm256_castpd256_pd128(u), _mm256_extractf128_pd(u, 1));
+  double r[2];
+  complex_real_dot_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = _mm_cvtsd_f64(t) + r[0];
+  y[1] = _mm_cvtsd_f64(_mm_unpackhi_pd(t, t)) + r[1];
+}
+
+__attribute__((target("avx512f"))) static void complex_real_dot_float_avx512(
+    const float *x, const float *h, size_t n, float *y) {
+  const __m512i lo =
+      _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+  const __m512i hi = _mm512_set_epi32(15, 15, 14, 14, 13, 13, 12, 12, 11, 11,
+                                      10, 10, 9, 9, 8, 8);
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 h16 = _mm512_loadu_ps(h + i);
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + 2 * i),
+                         _mm512_permutexvar_ps(lo, h16), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + 2 * i + 16),
+                         _mm512_permutexvar_ps(hi, h16), s1);
+  }
+  const __m512 s = _mm512_add_ps(s0, s1);
+  const __m256 u = _mm256_add_ps(
+      _mm512_castps512_ps256(s),
+      _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(s), 1)));
+  __m128 t = _mm_add_ps(_mm256_castps256_ps128(u), _mm256_extractf128_ps(u, 1));
+  t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+  float r[2];
+  complex_real_dot_float_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = _mm_cvtss_f32(t) + r[0];
+  y[1] = _mm_cvtss_f32(_mm_shuffle_ps(t, t, 1)) + r[1];
+}
+
+// Multiply and add are kept separate, rather than fused, so that results are
+// identical to axpy_rows_generic.
+__attribute__((target("avx2"))) static void axpy_rows_avx2(
+    size_t rows, const double *a, const double *x, size_t ldx, size_t n,
+    double *y) {
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256d s = _mm256_loadu_pd(y + k);
+    for (size_t j = 0; j < rows; j++)
+      s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(a[j]),
+                                         _mm256_loadu_pd(x + ldx * j + k)));
+    _mm256_storeu_pd(y + k, s);
+  }
+  axpy_rows_generic(rows, a, x + k, ldx, n - k, y + k);
+}
+
+__attribute__((target("avx512f"))) static void axpy_rows_avx512(
+    size_t rows, const double *a, const double *x, size_t ldx, size_t n,
+    double *y) {
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m512d s = _mm512_loadu_pd(y + k);
+    for (size_t j = 0; j < rows; j++)
+      s = _mm512_add_pd(s, _mm512_mul_pd(_mm512_set1_pd(a[j]),
+                                         _mm512_loadu_pd(x + ldx * j + k)));
+    _mm512_storeu_pd(y + k, s);
+  }
+  axpy_rows_generic(rows, a, x + k, ldx, n - k, y + k);
+}
+
+#endif  // MYRIOTA_SIMD_X86
+
+#ifdef MYRIOTA_SIMD_NEON
+
+// vld2 deinterleaves the samples into real and imaginary parts so the taps can
+// be used as loaded.
+
+static void complex_real_dot_neon(const double *x, const double *h, size_t n,
+                                  double *y) {
+  float64x2_t re0 = vdupq_n_f64(0), im0 = vdupq_n_f64(0);
+  float64x2_t re1 = vdupq_n_f64(0), im1 = vdupq_n_f64(0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float64x2x2_t a = vld2q_f64(x + 2 * i);
+    const float64x2x2_t b = vld2q_f64(x + 2 * i + 4);
+    const float64x2_t ha = vld1q_f64(h + i);
+    const float64x2_t hb = vld1q_f64(h + i + 2);
+    re0 = vfmaq_f64(re0, a.val[0], ha);
+    im0 = vfmaq_f64(im0, a.val[1], ha);
+    re1 = vfmaq_f64(re1, b.val[0], hb);
+    im1 = vfmaq_f64(im1, b.val[1], hb);
+  }
+  double r[2];
+  complex_real_dot_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = vaddvq_f64(vaddq_f64(re0, re1)) + r[0];
+  y[1] = vaddvq_f64(vaddq_f64(im0, im1)) + r[1];
+}
+
+static void complex_real_dot_float_neon(const float *x, const float *h,
+                                        size_t n, float *y) {
+  float32x4_t re0 = vdupq_n_f32(0), im0 = vdupq_n_f32(0);
+  float32x4_t re1 = vdupq_n_f32(0), im1 = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const float32x4x2_t a = vld2q_f32(x + 2 * i);
+    const float32x4x2_t b = vld2q_f32(x + 2 * i + 8);
+    const float32x4_t ha = vld1q_f32(h + i);
+    const float32x4_t hb = vld1q_f32(h + i + 4);
+    re0 = vfmaq_f32(re0, a.val[0], ha);
+    im0 = vfmaq_f32(im0, a.val[1], ha);
+    re1 = vfmaq_f32(re1, b.val[0], hb);
+    im1 = vfmaq_f32(im1, b.val[1], hb);
+  }
+  float r[2];
+  complex_real_dot_float_generic(x + 2 * i, h + i, n - i, r);
+  y[0] = vaddvq_f32(vaddq_f32(re0, re1)) + r[0];
+  y[1] = vaddvq_f32(vaddq_f32(im0, im1)) + r[1];
+}
+
+static void axpy_rows_neon(size_t rows, const double *a, const double *x,
+                           size_t ldx, size_t n, double *y) {
+  size_t k = 0;
+  for (; k + 2 <= n; k += 2) {
+    float64x2_t s = vld1q_f64(y + k);
+    for (size_t j = 0; j < rows; j++)
+      s = vaddq_f64(s, vmulq_n_f64(vld1q_f64(x + ldx * j + k), a[j]));
+    vst1q_f64(y + k, s);
+  }
+  axpy_rows_generic(rows, a, x + k, ldx, n - k, y + k);
+}
+
+#endif  // MYRIOTA_SIMD_NEON
+
+// CRC-32 kernels update the bit reflected register crc with n bytes and
+// return the new register, without the initial and final inversion.
+typedef uint32_t (*crc32_fn)(uint32_t, const uint8_t *, size_t);
+
+// Little endian 32 bit word at p regardless of alignment or byte order
+static inline uint32_t load_le32(const uint8_t *p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static uint32_t crc32_generic(uint32_t crc, const uint8_t *p, size_t n) {
+#if MYRIOTA_CRC32_SLICES == 8
+  const uint32_t(*t)[256] = crc32_slice_table;
+  for (; n >= 8; n -= 8, p += 8) {
+    const uint32_t a = crc ^ load_le32(p);
+    const uint32_t b = load_le32(p + 4);
+    crc = t[6][a & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][(a >> 16) & 0xff] ^
+          t[3][a >> 24] ^ t[2][b & 0xff] ^ t[1][(b >> 8) & 0xff] ^
+          t[0][(b >> 16) & 0xff] ^ crc32_table[b >> 24];
+  }
+#endif
+  for (; n > 0; n--, p++) crc = crc32_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef MYRIOTA_SIMD_X86
+
+// Carry-less multiplication folding, see "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction", Intel 2009. Four 128 bit lanes
+// are folded forward 64 bytes at a time, then folded into one lane, reduced
+// to 64 bits and finally Barrett reduced to 32 bits. Requires n >= 64 and n a
+// multiple of 16.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_pclmul_blocks(
+    uint32_t crc, const uint8_t *p, size_t n) {
+  // x^(4*128+64) mod P, x^(4*128) mod P, bit reflected and shifted by one
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  // x^(128+64) mod P, x^128 mod P
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  // x^64 mod P
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+  // P and floor(x^64 / P)
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+  __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  __m128i x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  p += 64;
+  n -= 64;
+
+  for (; n >= 64; n -= 64, p += 64) {
+    const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i *)(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((const __m128i *)(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((const __m128i *)(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((const __m128i *)(p + 0x30)));
+  }
+
+  // fold four lanes into one, then any remaining 16 byte blocks
+  __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+  for (; n >= 16; n -= 16, p += 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)),
+                       x5);
+  }
+
+  // 128 to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t n) {
+  if (n >= 64) {
+    const size_t blocks = n & ~(size_t)15;
+    crc = crc32_pclmul_blocks(crc, p, blocks);
+    p += blocks;
+    n -= blocks;
+  }
+  return crc32_generic(crc, p, n);
+}
+#endif  // MYRIOTA_SIMD_X86
+
+#ifdef MYRIOTA_SIMD_ARM_CRC
+__attribute__((target("+crc"))) static uint32_t crc32_arm(uint32_t crc,
+                                                          const uint8_t *p,
+                                                          size_t n) {
+  for (; n > 0 && ((uintptr_t)p & 7) != 0; n--) crc = __crc32b(crc, *p++);
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t w;  // memcpy rather than casting p keeps to strict aliasing
+    memcpy(&w, p, sizeof(w));
+    crc = __crc32d(crc, w);
+  }
+  for (; n > 0; n--) crc = __crc32b(crc, *p++);
+  return crc;
+}
+#endif  // MYRIOTA_SIMD_ARM_CRC
+
+// Base64 kernels decode whole blocks of characters into 3 bytes for every 4
+// characters, stopping before the first block containing an invalid
+// character, and return the number of characters decoded.
+typedef size_t (*base64_decode_fn)(const char *, size_t, uint8_t *);
+
+#ifndef MYRIOTA_SIMD_NEON
+static size_t base64_decode_blocks_generic(const char *s, size_t n,
+                                           uint8_t *buf) {
+  (void)s;
+  (void)n;
+  (void)buf;
+  return 0;  // left to the table driven decoder
+}
+#endif
+
+// Characters are classified by their high nibble as in "Faster Base64
+// Encoding and Decoding Using AVX2 Instructions", Muła and Lemire 2018. Bit k
+// of base64_lut_hi[h] marks a class of characters and base64_lut_lo[l] has bit
+// k set when the character with nibbles h, l is not in the alphabet, so the
+// two looked up bytes have a common bit only for invalid characters. The
+// amount added to a character to get its value depends only on the high
+// nibble, except that '/' is moved to row 1 to separate it from '+'.
+#if defined(MYRIOTA_SIMD_X86) || defined(MYRIOTA_SIMD_NEON)
+static const int8_t base64_lut_lo[16] = {0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                         0x1b, 0x1b, 0x1b, 0x1a};
+static const int8_t base64_lut_hi[16] = {0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                         0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10};
+static const int8_t base64_lut_roll[16] = {0,   16,  19, -48, -29, -29,
+                                           -87, -87, 0,  0,   0,   0,
+                                           0,   0,   0,  0};
+#endif
+
+#ifdef MYRIOTA_SIMD_X86
+
+// 16 characters at a time. The 6 bit values are merged pairwise into 12 and
+// then 24 bit words by multiply-adds and the three bytes of every word are
+// shuffled into big endian order.
+__attribute__((target("ssse3"))) static size_t base64_decode_blocks_ssse3(
+    const char *s, size_t n, uint8_t *buf) {
+  const __m128i lut_lo = _mm_loadu_si128((const __m128i *)base64_lut_lo);
+  const __m128i lut_hi = _mm_loadu_si128((const __m128i *)base64_lut_hi);
+  const __m128i lut_roll = _mm_loadu_si128((const __m128i *)base64_lut_roll);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i pack =
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  uint8_t out[16];
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i c = _mm_loadu_si128((const __m128i *)(s + i));
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(c, 4), nibble);
+    const __m128i lo = _mm_and_si128(c, nibble);
+    const __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                                          _mm_shuffle_epi8(lut_hi, hi));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, zero)) != 0xffff) break;
+    const __m128i roll = _mm_shuffle_epi8(
+        lut_roll, _mm_add_epi8(hi, _mm_cmpeq_epi8(c, slash)));
+    const __m128i v = _mm_add_epi8(c, roll);
+    const __m128i v12 = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    const __m128i v24 = _mm_madd_epi16(v12, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(v24, pack));
+    memcpy(buf + i / 4 * 3, out, 12);
+  }
+  return i;
+}
+
+#endif  // MYRIOTA_SIMD_X86
+
+#ifdef MYRIOTA_SIMD_NEON
+
+// Values of 16 characters, accumulating the invalid character flags
+static inline uint8x16_t base64_values_neon(uint8x16_t c, uint8x16_t *invalid) {
+  const uint8x16_t lut_lo = vreinterpretq_u8_s8(vld1q_s8(base64_lut_lo));
+  const uint8x16_t lut_hi = vreinterpretq_u8_s8(vld1q_s8(base64_lut_hi));
+  const uint8x16_t lut_roll = vreinterpretq_u8_s8(vld1q_s8(base64_lut_roll));
+  const uint8x16_t hi = vshrq_n_u8(c, 4);
+  const uint8x16_t lo = vandq_u8(c, vdupq_n_u8(0x0f));
+  *invalid = vorrq_u8(*invalid, vandq_u8(vqtbl1q_u8(lut_lo, lo),
+                                         vqtbl1q_u8(lut_hi, hi)));
+  const uint8x16_t row = vaddq_u8(hi, vceqq_u8(c, vdupq_n_u8('/')));
+  return vaddq_u8(c, vqtbl1q_u8(lut_roll, row));
+}
+
+// 64 characters at a time. vld4 splits the characters by their position in
+// each group of 4 and vst3 interleaves the 3 bytes decoded from each group.
+static size_t base64_decode_blocks_neon(const char *s, size_t n,
+                                        uint8_t *buf) {
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    const uint8x16x4_t c = vld4q_u8((const uint8_t *)s + i);
+    uint8x16_t invalid = vdupq_n_u8(0);
+    const uint8x16_t a = base64_values_neon(c.val[0], &invalid);
+    const uint8x16_t b = base64_values_neon(c.val[1], &invalid);
+    const uint8x16_t d = base64_values_neon(c.val[2], &invalid);
+    const uint8x16_t e = base64_values_neon(c.val[3], &invalid);
+    if (vmaxvq_u8(invalid) != 0) break;
+    uint8x16x3_t o;
+    o.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    o.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(d, 2));
+    o.val[2] = vorrq_u8(vshlq_n_u8(d, 6), e);
+    vst3q_u8(buf + i / 4 * 3, o);
+  }
+  return i;
+}
+
+#endif  // MYRIOTA_SIMD_NEON
+
+static crc32_fn crc32_update = crc32_generic;
+
+#if defined(MYRIOTA_SIMD_NEON)
+static base64_decode_fn base64_decode_blocks = base64_decode_blocks_neon;
+static axpy_rows_fn axpy_rows = axpy_rows_neon;
+static complex_real_dot_fn complex_real_dot = complex_real_dot_neon;
+static complex_real_dot_float_fn complex_real_dot_float =
+    complex_real_dot_float_neon;
+#else
+static base64_decode_fn base64_decode_blocks = base64_decode_blocks_generic;
+static axpy_rows_fn axpy_rows = axpy_rows_generic;
+static complex_real_dot_fn complex_real_dot = complex_real_dot_generic;
+static complex_real_dot_float_fn complex_real_dot_float =
+    complex_real_dot_float_generic;
+#endif
+
+#ifdef MYRIOTA_SIMD_X86
+// Select kernels once at load time, before any threads are started
+__attribute__((constructor)) static void myriota_simd_init(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    complex_real_dot = complex_real_dot_avx512;
+    complex_real_dot_float = complex_real_dot_float_avx512;
+    axpy_rows = axpy_rows_avx512;
+  } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    complex_real_dot = complex_real_dot_avx2;
+    complex_real_dot_float = complex_real_dot_float_avx2;
+    axpy_rows = axpy_rows_avx2;
+  }
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+    crc32_update = crc32_pclmul;
+  if (__builtin_cpu_supports("ssse3"))
+    base64_decode_blocks = base64_decode_blocks_ssse3;
+}
+#endif
+
+#ifdef MYRIOTA_SIMD_ARM_CRC
+__attribute__((constructor)) static void myriota_simd_init(void) {
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32) crc32_update = crc32_arm;
+}
+#endif
+
+void myriota_complex_real_dot(const double *x, const double *h, size_t n,
+                              double *y) {
+  complex_real_dot(x, h, n, y);
+}
+
+void myriota_complex_real_dot_float(const float *x, const float *h, size_t n,
+                                    float *y) {
+  complex_real_dot_float(x, h, n, y);
+}
+
+// The register is kept most significant bit first, starting at ~offset, with
+// every byte bit reversed before it is shifted in, and the result is the
+// bit reversal of the inverted register. In bit reflected form this is the
+// standard CRC-32 starting from ~reverse_bits(offset).
+static uint32_t reverse_bits(uint32_t x) {
+  x = ((x & 0x55555555) << 1) | ((x >> 1) & 0x55555555);
+  x = ((x & 0x33333333) << 2) | ((x >> 2) & 0x33333333);
+  x = ((x & 0x0F0F0F0F) << 4) | ((x >> 4) & 0x0F0F0F0F);
+  x = (x << 24) | ((x & 0xFF00) << 8) | ((x >> 8) & 0xFF00) | (x >> 24);
+  return x;
+}
+
+void myriota_axpy_rows(size_t rows, const double *a, const double *x,
+                       size_t ldx, size_t n, double *y) {
+  axpy_rows(rows, a, x, ldx, n, y);
+}
+
+size_t myriota_base64_decode_blocks(const char *s, size_t n, uint8_t *buf) {
+  return base64_decode_blocks(s, n, buf);
+}
+
+uint32_t myriota_crc32(const void *data, size_t length, uint32_t offset) {
+  return ~crc32_update(~reverse_bits(offset), (const uint8_t *)data, length);
+}
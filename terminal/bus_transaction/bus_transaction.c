@@ -0,0 +1,91 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "bus_transaction.h"
+#include <string.h>
+
+void BusTransactionInit(BusTransaction *Transaction, const BusDevice *Device) {
+  Transaction->Device = Device;
+  Transaction->Count = 0;
+}
+
+static int Add(BusTransaction *Transaction, bool Read, uint8_t Register,
+               uint8_t *Data, size_t Length, uint8_t Value) {
+  if (Transaction->Count == BUS_TRANSACTION_MAX_TRANSFERS ||
+      Length > BUS_TRANSACTION_MAX_LENGTH)
+    return -1;
+  BusTransfer *t = &Transaction->Transfers[Transaction->Count++];
+  t->Read = Read;
+  t->Register = Register;
+  t->Value = Value;
+  t->Length = Length;
+  t->Data = Data;
+  return 0;
+}
+
+int BusTransactionRead(BusTransaction *Transaction, uint8_t Register,
+                       uint8_t *Data, size_t Length) {
+  return Add(Transaction, true, Register, Data, Length, 0);
+}
+
+int BusTransactionWrite(BusTransaction *Transaction, uint8_t Register,
+                        const uint8_t *Data, size_t Length) {
+  return Add(Transaction, false, Register, (uint8_t *)Data, Length, 0);
+}
+
+int BusTransactionWrite8(BusTransaction *Transaction, uint8_t Register,
+                         uint8_t Value) {
+  return Add(Transaction, false, Register, NULL, 1, Value);
+}
+
+static int Transfer(BusTransaction *Transaction, const BusTransfer *t) {
+  const BusDevice *d = Transaction->Device;
+  uint8_t reg = t->Register;
+  if (t->Length > 1) reg |= d->BurstFlags;
+  if (t->Read) reg |= d->ReadFlags;
+  uint8_t *tx = Transaction->Tx;
+  tx[0] = reg;
+  if (t->Read) {
+    if (d->Interface == BUS_I2C)
+      return I2CRead(d->Address, tx, 1, t->Data, t->Length);
+    // clock out the register address, then zeros while the data is read
+    memset(tx + 1, 0, t->Length);
+    if (SPITransfer(tx, Transaction->Rx, 1 + t->Length) != 0) return -1;
+    memcpy(t->Data, Transaction->Rx + 1, t->Length);
+    return 0;
+  }
+  if (t->Data != NULL)
+    memcpy(tx + 1, t->Data, t->Length);
+  else
+    tx[1] = t->Value;
+  if (d->Interface == BUS_I2C) return I2CWrite(d->Address, tx, 1 + t->Length);
+  return SPIWrite(tx, 1 + t->Length);
+}
+
+int BusTransactionRun(BusTransaction *Transaction) {
+  const BusDevice *d = Transaction->Device;
+  const unsigned int count = Transaction->Count;
+  Transaction->Count = 0;
+  if (count == 0) return 0;
+  if ((d->Interface == BUS_I2C ? I2CInit() : SPIInit(d->BaudRate)) != 0)
+    return -1;
+  int result = 0;
+  for (unsigned int i = 0; i < count && result == 0; i++)
+    result = Transfer(Transaction, &Transaction->Transfers[i]);
+  if (d->Interface == BUS_I2C)
+    I2CDeinit();
+  else
+    SPIDeinit();
+  return result != 0 ? -1 : 0;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Batched register transfers over I2C and SPI
+
+#ifndef BUS_TRANSACTION_H
+#define BUS_TRANSACTION_H
+
+#include "myriota_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup Bus_transaction I2C and SPI transactions
+/// Queues reads and writes of the registers of an I2C or SPI device and runs
+/// them together, initialising the bus once rather than per register. Reads
+/// of many bytes, e.g. of a sensor FIFO, are a single burst transfer, e.g.
+/// for the LIS3DH over I2C, with the register address auto incremented:
+/// \code
+/// static const BusDevice LIS3DH = {BUS_I2C, 0x18, 0, 0, 0x80};
+/// BusTransaction t;
+/// BusTransactionInit(&t, &LIS3DH);
+/// BusTransactionWrite8(&t, LIS3DH_REG_CTRL1, 0x47);
+/// BusTransactionRead(&t, LIS3DH_REG_OUT_X_L, Samples, 32 * 6);
+/// BusTransactionRun(&t);
+/// \endcode
+/// or over SPI with {BUS_SPI, 0, SPI_BAUDRATE_DEFAULT, 0x80, 0x40}.
+/// @{
+
+/// Most transfers of a transaction
+#define BUS_TRANSACTION_MAX_TRANSFERS 16
+/// Most bytes of a transfer, 32 samples of 6 bytes of the LIS3DH FIFO
+#define BUS_TRANSACTION_MAX_LENGTH 192
+
+typedef enum { BUS_I2C = 0, BUS_SPI } BusInterface;
+
+typedef struct {
+  BusInterface Interface;
+  uint16_t Address;    ///< of an I2C device
+  uint32_t BaudRate;   ///< of an SPI device
+  uint8_t ReadFlags;   ///< set in the register address of reads
+  uint8_t BurstFlags;  ///< set in the register address of transfers of more
+                       ///< than one byte, to auto increment the address
+} BusDevice;
+
+typedef struct {
+  bool Read;
+  uint8_t Register;
+  uint8_t Value;  ///< written if Data is NULL
+  uint16_t Length;
+  uint8_t *Data;
+} BusTransfer;
+
+typedef struct {
+  const BusDevice *Device;
+  BusTransfer Transfers[BUS_TRANSACTION_MAX_TRANSFERS];
+  unsigned int Count;
+  uint8_t Tx[1 + BUS_TRANSACTION_MAX_LENGTH];
+  uint8_t Rx[1 + BUS_TRANSACTION_MAX_LENGTH];
+} BusTransaction;
+
+/// Start an empty transaction with \p Device.
+void BusTransactionInit(BusTransaction *Transaction, const BusDevice *Device);
+/// Queue a read of \p Length bytes from \p Register into \p Data.
+/// Returns 0 if succeeded and -1 if the transaction is full or \p Length is
+/// more than #BUS_TRANSACTION_MAX_LENGTH.
+int BusTransactionRead(BusTransaction *Transaction, uint8_t Register,
+                       uint8_t *Data, size_t Length);
+/// Queue a write of the \p Length bytes of \p Data, which must be kept until
+/// the transaction runs, to \p Register.
+/// Returns 0 if succeeded and -1 if the transaction is full or \p Length is
+/// more than #BUS_TRANSACTION_MAX_LENGTH.
+int BusTransactionWrite(BusTransaction *Transaction, uint8_t Register,
+                        const uint8_t *Data, size_t Length);
+/// Queue a write of a single byte to \p Register.
+/// Returns 0 if succeeded and -1 if the transaction is full.
+int BusTransactionWrite8(BusTransaction *Transaction, uint8_t Register,
+                         uint8_t Value);
+/// Run the queued transfers in order between a single initialisation and
+/// deinitialisation of the bus, stopping at the first that fails, and empty
+/// the transaction.
+/// Returns 0 if succeeded and -1 if failed.
+int BusTransactionRun(BusTransaction *Transaction);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BUS_TRANSACTION_H
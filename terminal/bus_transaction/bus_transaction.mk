@@ -0,0 +1,24 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Links the I2C and SPI transactions of bus_transaction.h into the
+# application. Include before terminal/app.mk.
+
+include $(ROOTDIR)/terminal/component.mk
+
+BUS_TRANSACTION_DIR:=$(ROOTDIR)/terminal/bus_transaction
+BUS_TRANSACTION_OBJ:=$(call component_object,\
+	$(BUS_TRANSACTION_DIR)/bus_transaction.c)
+OBJ_LIST+=$(BUS_TRANSACTION_OBJ)
+-include $(BUS_TRANSACTION_OBJ:.o=.d)
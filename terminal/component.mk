@@ -0,0 +1,32 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+
+# Builds the sources of the optional terminal components, such as
+# message_batch.mk, in the .obj directory of the application rather than next
+# to the sources, as math/build.mk does for myriotamath. Applications built
+# for different platforms then do not share objects, and make clean in one
+# application leaves the others alone. Included by the component .mk files.
+
+ifndef COMPONENT_BUILD_DIR
+COMPONENT_BUILD_DIR:=$(abspath .obj)
+
+# object of component source file $(1)
+component_object=$(patsubst %.c,$(COMPONENT_BUILD_DIR)%.o,$(abspath $(1)))
+
+# MMD flag builds header dependency files
+$(COMPONENT_BUILD_DIR)%.o : %.c
+	mkdir -p $(dir $@)
+	$(CC) $(CFLAGS) -MMD -c $< -o $@
+endif
@@ -0,0 +1,41 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Discrete event simulator, selected with SIM=fast on a sim platform. Links the
+# application against fastsim.c in place of sim.so and the orbit model, and
+# against pass_table.c for tables given with -P.
+
+include $(ROOTDIR)/terminal/sim/flags.mk
+
+FASTSIM_DIR:=$(ROOTDIR)/terminal/fastsim
+LDFLAGS = -lm -pthread -Wall -Werror
+include $(ROOTDIR)/terminal/component.mk
+PASS_TABLE_DIR:=$(ROOTDIR)/terminal/pass_table
+PASS_TABLE_OBJ:=$(call component_object,$(PASS_TABLE_DIR)/pass_table.c)
+FASTSIM_OBJ:=$(call component_object,$(FASTSIM_DIR)/fastsim.c)
+OBJ_LIST+=$(FASTSIM_OBJ)
+ifeq ($(filter $(PASS_TABLE_OBJ),$(OBJ_LIST)),)
+OBJ_LIST+=$(PASS_TABLE_OBJ)
+endif
+-include $(FASTSIM_OBJ:.o=.d) $(PASS_TABLE_OBJ:.o=.d)
+
+$(FASTSIM_OBJ) $(PASS_TABLE_OBJ): CFLAGS += -O2 -DMYRIOTA_SDK_VERSION=\"$(shell cat $(ROOTDIR)/VERSION)\"
+
+$(PROGRAM_NAME) : $(OBJ_LIST)
+	$(CC) $(OBJ_LIST) $(LDFLAGS) -o $@
+
+clean:
+	rm -f $(OBJ_LIST) $(PROGRAM_NAME)
+
+.DEFAULT_GOAL:=$(PROGRAM_NAME)
@@ -0,0 +1,608 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Discrete event simulator of the Myriota terminal user API. Simulated time
+// jumps straight to the next scheduled job or ScheduleHook event, so there are
+// no wall clock waits and months of operation run in a fraction of a second.
+//
+// Many virtual modules are simulated by forking a process per module from a
+// parent that never runs the application, so every module starts from pristine
+// application state. Up to a given number of modules run concurrently.
+//
+// Satellite passes are periodic, or looked up in a pass table made by
+// pass_table_gen where it covers the location and time. GNSS fixes started by
+// GNSSFixStart are acquired while other jobs run.
+//
+// Hardware API functions are weak, so simulation code of the application, e.g.
+// sim.c of the examples, overrides them.
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "myriota_user_api.h"
+#include "terminal/gnss_async/gnss_async.h"
+#include "terminal/pass_table/pass_table.h"
+
+#define WEAK __attribute__((weak))
+
+#define MAX_JOBS 32
+
+// Job times at or above EVENT_TIME wait for an event rather than a time
+#define NEVER_TIME ((time_t)1 << 62)
+#define GPIO_WAKEUP_TIME (NEVER_TIME - 1)
+#define PULSE_COUNTER_TIME (NEVER_TIME - 2)
+#define LEUART_RECEIVE_TIME (NEVER_TIME - 3)
+#define GNSS_FIX_TIME (NEVER_TIME - 4)
+#define EVENT_TIME GNSS_FIX_TIME
+// Jobs at or above HOOK_EVENT_TIME run on events of ScheduleHook
+#define HOOK_EVENT_TIME LEUART_RECEIVE_TIME
+
+// Counters of a simulated module, reported to the parent on exit
+typedef struct {
+  uint64_t job_runs;
+  uint64_t wakeups;
+  uint64_t events;
+  uint64_t messages;
+  uint64_t gnss_fixes;
+  uint64_t log_entries;
+  double message_latency;  // seconds from messages to transmit opportunities
+  double days;
+} fastsim_stats;
+
+typedef struct {
+  ScheduledJob job;
+  time_t time;
+} fastsim_job;
+
+// Parameters of the simulation, the same for every module
+typedef struct {
+  unsigned int modules;
+  unsigned int processes;
+  double days;
+  time_t start;
+  unsigned int seed;
+  bool verbose;
+  bool fixed_location;
+  double latitude, longitude;     // degrees
+  unsigned int pass_interval;     // seconds between satellite passes
+  unsigned int transmit_lead;     // seconds before a pass
+  unsigned int gnss_fix_time;     // seconds per GNSS fix
+  unsigned int messages_per_day;  // capacity for message load
+  const char *pass_table;         // file of transmit times, or NULL
+} fastsim_options;
+
+static fastsim_options options = {.modules = 1,
+                                  .days = 30,
+                                  .start = 1561939200,
+                                  .seed = 1,
+                                  .pass_interval = 5400,
+                                  .transmit_lead = 60,
+                                  .gnss_fix_time = 30,
+                                  .messages_per_day = 24};
+
+// State of the module being simulated
+static struct {
+  fastsim_job jobs[MAX_JOBS];
+  unsigned int job_count;
+  int64_t now;    // simulated milliseconds since the epoch
+  int64_t start;  // milliseconds at start of simulation
+  int64_t end;    // milliseconds at end of simulation
+  int32_t latitude, longitude;
+  time_t fix_time;
+  bool has_fix;
+  int64_t fix_done;  // milliseconds at the end of the acquisition, or 0
+  int fix_result;
+  unsigned int pass_phase;
+  time_t message_times[256];  // ring of recent message times
+  unsigned int message_count;
+  uint32_t module_id;
+  fastsim_stats stats;
+} sim;
+
+static PassTable pass_table;  // mapped by the parent, shared by modules
+static int stats_fd = -1;     // pipe to the parent
+
+static time_t now_seconds() { return sim.now / 1000; }
+
+// Report the counters to the parent and end the module process
+static void finish(void) {
+  sim.stats.days = (double)(sim.now - sim.start) / 86400000;
+  fflush(stdout);
+  const bool ok =
+      write(stats_fd, &sim.stats, sizeof(sim.stats)) == sizeof(sim.stats);
+  _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Called wherever the application can spend time outside of the scheduler,
+// e.g. busy loops on TickGet and sandbox applications that never return from
+// BoardStart, so that these end with the simulation too
+static void advance(int64_t ms) {
+  sim.now += ms;
+  if (sim.now >= sim.end) finish();
+}
+
+// Overrides the C library, so applications calling time see simulated time
+time_t time(time_t *t) {
+  const time_t now = now_seconds();
+  if (t != NULL) *t = now;
+  return now;
+}
+
+void SDKVersionGet(uint32_t *Major, uint32_t *Minor, uint32_t *Patch) {
+  unsigned int major = 0, minor = 0, patch = 0;
+  sscanf(MYRIOTA_SDK_VERSION, "%u.%u.%u", &major, &minor, &patch);
+  *Major = major;
+  *Minor = minor;
+  *Patch = patch;
+}
+
+char *ModuleIDGet(void) {
+  static char id[24];
+  snprintf(id, sizeof(id), "00%08" PRIx32 " M1-24", sim.module_id);
+  return id;
+}
+
+int ScheduleJob(ScheduledJob Job, time_t Time) {
+  for (unsigned int i = 0; i < sim.job_count; i++) {
+    if (sim.jobs[i].job == Job) {
+      sim.jobs[i].time = Time;
+      return 0;
+    }
+  }
+  if (sim.job_count == MAX_JOBS) return -1;
+  sim.jobs[sim.job_count].job = Job;
+  sim.jobs[sim.job_count].time = Time;
+  sim.job_count++;
+  return 0;
+}
+
+time_t ASAP(void) { return now_seconds(); }
+time_t Never(void) { return NEVER_TIME; }
+time_t SecondsFromNow(unsigned Secs) { return now_seconds() + Secs; }
+time_t MinutesFromNow(unsigned Mins) { return now_seconds() + 60 * Mins; }
+time_t HoursFromNow(unsigned Hours) { return now_seconds() + 3600 * Hours; }
+time_t DaysFromNow(unsigned Days) { return now_seconds() + 86400 * Days; }
+time_t OnGPIOWakeup(void) { return GPIO_WAKEUP_TIME; }
+time_t OnPulseCounterEvent(void) { return PULSE_COUNTER_TIME; }
+time_t OnLeuartReceive(void) { return LEUART_RECEIVE_TIME; }
+time_t OnGNSSFix(void) { return GNSS_FIX_TIME; }
+
+// Satellite passes are modelled as periodic, with a phase chosen per module,
+// unless given by the pass table
+time_t BeforeSatelliteTransmit(time_t After, time_t Before) {
+  time_t t;
+  if (options.pass_table != NULL &&
+      PassTableBeforeSatelliteTransmit(&pass_table, sim.latitude,
+                                       sim.longitude, After, Before, &t) == 0)
+    return t;
+  const time_t interval = options.pass_interval;
+  const time_t earliest = After + options.transmit_lead;
+  time_t pass = (earliest - sim.pass_phase + interval - 1) / interval;
+  pass = pass * interval + sim.pass_phase;
+  t = pass - options.transmit_lead;
+  return t < Before ? t : Before;
+}
+
+float ScheduleMessage(const uint8_t *Message, size_t MessageSize) {
+  if (Message == NULL || MessageSize > MAX_MESSAGE_SIZE) return NAN;
+  const unsigned int ring = sizeof(sim.message_times) / sizeof(time_t);
+  const time_t now = now_seconds();
+  sim.message_times[sim.message_count % ring] = now;
+  sim.message_count++;
+  sim.stats.messages++;
+  sim.stats.message_latency +=
+      BeforeSatelliteTransmit(now, now + 7 * 86400) - now;
+  // load is the number of messages in the last day relative to capacity
+  unsigned int recent = 0;
+  for (unsigned int i = 0; i < ring && i < sim.message_count; i++)
+    if (now - sim.message_times[i] < 86400) recent++;
+  return (float)recent / options.messages_per_day;
+}
+
+void Delay(uint32_t mSec) { advance(mSec); }
+void Sleep(uint32_t Sec) { advance(1000 * (int64_t)Sec); }
+
+int GNSSFix(void) {
+  advance(1000 * (int64_t)options.gnss_fix_time);
+  sim.fix_time = now_seconds();
+  sim.has_fix = true;
+  sim.stats.gnss_fixes++;
+  return 0;
+}
+
+int GNSSFixStart(void) {
+  if (sim.fix_done == 0) {
+    sim.fix_done = sim.now + 1000 * (int64_t)options.gnss_fix_time;
+    sim.fix_result = -1;
+  }
+  return 0;
+}
+
+int GNSSFixResult(void) { return sim.fix_result; }
+
+bool HasValidGNSSFix(void) { return sim.has_fix; }
+
+void LocationGet(int32_t *Latitude, int32_t *Longitude, time_t *TimeStamp) {
+  *Latitude = sim.latitude;
+  *Longitude = sim.longitude;
+  *TimeStamp = sim.fix_time;
+}
+
+void LocationSet(int32_t Latitude, int32_t Longitude) {
+  sim.latitude = Latitude;
+  sim.longitude = Longitude;
+}
+
+time_t TimeGet(void) { return now_seconds(); }
+void TimeSet(time_t Time) { sim.now = 1000 * (int64_t)Time; }
+// Every call takes a tick, so loops polling the tick make progress
+uint32_t TickGet(void) {
+  const uint32_t tick = sim.now - sim.start;
+  advance(1);
+  return tick;
+}
+
+int LogAdd(uint8_t ErrorCode, const void *Buffer, uint8_t BufferSize) {
+  if (ErrorCode > 127) return -1;
+  sim.stats.log_entries++;
+  return 0;
+}
+
+WEAK int TemperatureGet(float *Temperature) {
+  *Temperature = 25;
+  return 0;
+}
+
+WEAK void LedTurnOn(void) {}
+WEAK void LedTurnOff(void) {}
+WEAK void LedToggle(void) {}
+
+WEAK int BatteryGetVoltage(uint32_t *mV) {
+  *mV = 3300;
+  return 0;
+}
+
+WEAK int ADCGetVoltage(uint8_t PinNum, ADCReference Reference, uint32_t *mV) {
+  *mV = 0;
+  return 0;
+}
+
+WEAK int ADCGetValue(uint8_t PinNum, ADCReference Reference, uint16_t *Value) {
+  *Value = 0;
+  return 0;
+}
+
+WEAK int I2CInit(void) { return 0; }
+WEAK void I2CDeinit(void) {}
+WEAK int I2CWrite(uint16_t DeviceAddress, const uint8_t *Command,
+                  size_t CommandLength) {
+  return 0;
+}
+WEAK int I2CRead(uint16_t DeviceAddress, const uint8_t *Command,
+                 size_t CommandLength, uint8_t *Rx, size_t RxLength) {
+  memset(Rx, 0, RxLength);
+  return 0;
+}
+
+WEAK int SPIInit(uint32_t BaudRate) { return 0; }
+WEAK void SPIDeinit(void) {}
+WEAK int SPIWrite(const uint8_t *Tx, size_t Length) { return 0; }
+WEAK int SPITransfer(const uint8_t *Tx, uint8_t *Rx, size_t Length) {
+  memset(Rx, 0, Length);
+  return 0;
+}
+
+WEAK int GPIOSetModeInput(uint8_t PinNum, GPIOPull Pull) { return 0; }
+WEAK int GPIOSetModeOutput(uint8_t PinNum) { return 0; }
+WEAK int GPIOSetHigh(uint8_t PinNum) { return 0; }
+WEAK int GPIOSetLow(uint8_t PinNum) { return 0; }
+WEAK int GPIOGet(uint8_t PinNum) { return GPIO_LOW; }
+WEAK int GPIOSetWakeupLevel(uint8_t PinNum, GPIOLevel Level) { return 0; }
+WEAK int GPIODisableWakeup(uint8_t PinNum) { return 0; }
+
+WEAK void *UARTInit(UARTInterface UARTNum, uint32_t BaudRate,
+                    uint32_t Options) {
+  static int handles[LEUART + 1];
+  return UARTNum <= LEUART ? &handles[UARTNum] : NULL;
+}
+WEAK void UARTDeinit(void *Handle) {}
+WEAK int UARTWrite(void *Handle, const uint8_t *Tx, size_t Length) {
+  return 0;
+}
+WEAK int UARTRead(void *Handle, uint8_t *Rx, size_t Length) { return 0; }
+
+WEAK int PulseCounterInit(uint32_t Limit, uint32_t Options) { return 0; }
+WEAK uint64_t PulseCounterGet(void) { return 0; }
+WEAK void PulseCounterDeinit(void) {}
+
+WEAK int RFTestTxStart(uint32_t Frequency, uint8_t TxType, bool IsBurst) {
+  return 0;
+}
+WEAK void RFTestTxStop(void) {}
+
+WEAK time_t ScheduleHook(time_t Next) { return 0; }
+
+WEAK int BoardStart(void) { return 0; }
+
+// Index of the job due first, or -1 if no job waits on a time
+static int next_job() {
+  int next = -1;
+  for (unsigned int i = 0; i < sim.job_count; i++)
+    if (sim.jobs[i].time < EVENT_TIME &&
+        (next < 0 || sim.jobs[i].time < sim.jobs[next].time))
+      next = i;
+  return next;
+}
+
+static void run_job(unsigned int i, int64_t *awake_until) {
+  if (sim.now > *awake_until) sim.stats.wakeups++;
+  const ScheduledJob job = sim.jobs[i].job;
+  const time_t next = job();
+  // the job may have rescheduled, so find it again
+  for (unsigned int j = 0; j < sim.job_count; j++)
+    if (sim.jobs[j].job == job) sim.jobs[j].time = next;
+  sim.stats.job_runs++;
+  sim.now++;  // a job takes at least a tick
+  *awake_until = sim.now;
+}
+
+// Complete the acquisition started by GNSSFixStart and run the jobs waiting
+static void complete_fix(int64_t *awake_until) {
+  if (sim.fix_done > sim.now) sim.now = sim.fix_done;
+  sim.fix_done = 0;
+  sim.fix_time = now_seconds();
+  sim.has_fix = true;
+  sim.fix_result = 0;
+  sim.stats.gnss_fixes++;
+  for (unsigned int j = 0; j < sim.job_count; j++)
+    if (sim.jobs[j].time == GNSS_FIX_TIME) run_job(j, awake_until);
+}
+
+// Simulate a single module until the end time, then exit
+static void simulate_module(unsigned int module) {
+  srand(options.seed + module);
+  memset(&sim, 0, sizeof(sim));
+  sim.module_id = options.seed * 100003 + module;
+  sim.now = sim.start = 1000 * (int64_t)options.start;
+  sim.pass_phase = rand() % options.pass_interval;
+  const double latitude = options.fixed_location
+                              ? options.latitude
+                              : 180.0 * rand() / RAND_MAX - 90;
+  const double longitude = options.fixed_location
+                               ? options.longitude
+                               : 360.0 * rand() / RAND_MAX - 180;
+  sim.latitude = latitude * 1e7;
+  sim.longitude = longitude * 1e7;
+  sim.end = sim.start + (int64_t)(options.days * 86400000);
+  const int64_t end = sim.end;
+  int64_t awake_until = sim.now;
+
+  BoardStart();
+  AppInit();
+  while (sim.now < end) {
+    const int i = next_job();
+    time_t next = i < 0 ? end / 1000 : sim.jobs[i].time;
+    if (next > end / 1000) next = end / 1000;
+    if (sim.fix_done != 0 && sim.fix_done <= 1000 * (int64_t)next) {
+      complete_fix(&awake_until);
+      continue;
+    }
+    // events injected by the simulation code wake the waiting jobs
+    const time_t event = ScheduleHook(next);
+    if (event != 0 && event < next) {
+      if (1000 * (int64_t)event > sim.now) sim.now = 1000 * (int64_t)event;
+      sim.stats.events++;
+      const uint64_t runs = sim.stats.job_runs;
+      for (unsigned int j = 0; j < sim.job_count; j++)
+        if (sim.jobs[j].time >= HOOK_EVENT_TIME &&
+            sim.jobs[j].time < NEVER_TIME)
+          run_job(j, &awake_until);
+      if (sim.stats.job_runs == runs) sim.now++;  // no job waits, move on
+      continue;
+    }
+    if (i < 0 || sim.jobs[i].time > end / 1000) break;
+    if (1000 * (int64_t)sim.jobs[i].time > sim.now)
+      sim.now = 1000 * (int64_t)sim.jobs[i].time;
+    run_job(i, &awake_until);
+  }
+  sim.now = end;  // nothing left to run before the end
+  finish();
+}
+
+static double wall_seconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "Discrete event simulation of the application on many modules.\n"
+          "options:\n"
+          "  -n modules    number of modules to simulate (default 1)\n"
+          "  -d days       simulated days per module (default 30)\n"
+          "  -j processes  modules simulated concurrently (default CPUs)\n"
+          "  -t time       epoch time at the start (default 1561939200)\n"
+          "  -s seed       seed of module locations and pass phases\n"
+          "  -l lat,lon    location of every module in degrees (default "
+          "random)\n"
+          "  -p seconds    interval between satellite passes (default 5400)\n"
+          "  -g seconds    duration of a GNSS fix (default 30)\n"
+          "  -m messages   messages per day for a load of one (default 24)\n"
+          "  -P file       satellite pass table made by pass_table_gen\n"
+          "  -v            keep application output, default only for one "
+          "module\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+static void parse_options(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "n:d:j:t:s:l:p:g:m:P:vh")) != -1) {
+    switch (c) {
+      case 'n':
+        options.modules = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        options.days = strtod(optarg, NULL);
+        break;
+      case 'j':
+        options.processes = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        options.start = strtoll(optarg, NULL, 10);
+        break;
+      case 's':
+        options.seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        if (sscanf(optarg, "%lf,%lf", &options.latitude, &options.longitude) !=
+            2)
+          usage(argv[0]);
+        options.fixed_location = true;
+        break;
+      case 'p':
+        options.pass_interval = strtoul(optarg, NULL, 10);
+        break;
+      case 'g':
+        options.gnss_fix_time = strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        options.messages_per_day = strtoul(optarg, NULL, 10);
+        break;
+      case 'P':
+        options.pass_table = optarg;
+        break;
+      case 'v':
+        options.verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (options.modules == 0 || options.days <= 0 ||
+      options.pass_interval == 0 || options.messages_per_day == 0)
+    usage(argv[0]);
+  if (options.processes == 0) options.processes = sysconf(_SC_NPROCESSORS_ONLN);
+  if (options.processes == 0) options.processes = 1;
+  if (options.modules == 1) options.verbose = true;
+}
+
+typedef struct {
+  pid_t pid;
+  int fd;
+} fastsim_child;
+
+static pid_t start_module(unsigned int module, int *fd) {
+  int p[2];
+  if (pipe(p) != 0) return -1;
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid != 0) {
+    close(p[1]);
+    *fd = p[0];
+    if (pid < 0) close(p[0]);
+    return pid;
+  }
+  close(p[0]);
+  stats_fd = p[1];
+  atexit(finish);  // applications calling exit end the module
+  signal(SIGUSR1, SIG_IGN);  // raised by simulation code of the examples
+  if (!options.verbose && freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+  simulate_module(module);
+  return 0;
+}
+
+// Wait for any child, add its counters to total and free its slot
+static int finish_module(fastsim_child *children, unsigned int *running,
+                         fastsim_stats *total) {
+  int status;
+  const pid_t pid = wait(&status);
+  for (unsigned int i = 0; i < *running; i++) {
+    if (children[i].pid != pid) continue;
+    fastsim_stats s;
+    const bool ok = read(children[i].fd, &s, sizeof(s)) == sizeof(s) &&
+                    WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    close(children[i].fd);
+    children[i] = children[--*running];
+    if (!ok) return -1;
+    total->job_runs += s.job_runs;
+    total->wakeups += s.wakeups;
+    total->events += s.events;
+    total->messages += s.messages;
+    total->gnss_fixes += s.gnss_fixes;
+    total->log_entries += s.log_entries;
+    total->message_latency += s.message_latency;
+    total->days += s.days;
+    return 0;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  parse_options(argc, argv);
+  if (options.pass_table != NULL &&
+      PassTableMap(&pass_table, options.pass_table) != 0) {
+    fprintf(stderr, "Failed to open pass table %s\n", options.pass_table);
+    return EXIT_FAILURE;
+  }
+
+  fastsim_child *children = calloc(options.processes, sizeof(fastsim_child));
+  if (children == NULL) return EXIT_FAILURE;
+  fastsim_stats total = {0};
+  unsigned int running = 0, failed = 0;
+  const double start = wall_seconds();
+  for (unsigned int m = 0; m < options.modules; m++) {
+    if (running == options.processes &&
+        finish_module(children, &running, &total) != 0)
+      failed++;
+    children[running].pid = start_module(m, &children[running].fd);
+    if (children[running].pid < 0) {
+      fprintf(stderr, "Failed to start module %u\n", m);
+      failed++;
+      continue;
+    }
+    running++;
+  }
+  while (running > 0)
+    if (finish_module(children, &running, &total) != 0) failed++;
+  const double elapsed = wall_seconds() - start;
+  free(children);
+  if (options.pass_table != NULL) PassTableUnmap(&pass_table);
+
+  fprintf(stderr,
+          "Simulated %u modules for %.1f days in %.3f s, %.0f simulated days "
+          "per second\n",
+          options.modules - failed, total.days, elapsed,
+          total.days / (elapsed > 0 ? elapsed : 1e-9));
+  if (total.days > 0)
+    fprintf(stderr,
+            "Per module day: %.2f job runs, %.2f wakeups, %.2f events, %.2f "
+            "messages, %.2f GNSS fixes, %.2f log entries\n",
+            total.job_runs / total.days, total.wakeups / total.days,
+            total.events / total.days, total.messages / total.days,
+            total.gnss_fixes / total.days, total.log_entries / total.days);
+  if (total.messages > 0)
+    fprintf(stderr,
+            "Mean of %.1f minutes from messages to transmit opportunities\n",
+            total.message_latency / total.messages / 60);
+  if (failed > 0) fprintf(stderr, "%u modules failed\n", failed);
+  return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
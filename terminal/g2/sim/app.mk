@@ -12,4 +12,9 @@
 # limitations under the License.
 
 
+# SIM=fast selects the discrete event simulator
+ifeq ($(SIM),fast)
+include $(ROOTDIR)/terminal/fastsim/app.mk
+else
 include $(ROOTDIR)/terminal/sim/app.mk
+endif
@@ -0,0 +1,32 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Implementation of the asynchronous fix on platforms whose scheduler has no
+// GNSS event. The functions are weak as the discrete event simulator defines
+// them too.
+
+#include "gnss_async.h"
+
+#define WEAK __attribute__((weak))
+
+static int Result = -1;
+
+WEAK int GNSSFixStart(void) {
+  Result = GNSSFix();
+  return 0;
+}
+
+WEAK time_t OnGNSSFix(void) { return ASAP(); }
+
+WEAK int GNSSFixResult(void) { return Result; }
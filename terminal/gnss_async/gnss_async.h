@@ -0,0 +1,65 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Asynchronous GNSS fixes
+
+#ifndef GNSS_ASYNC_H
+#define GNSS_ASYNC_H
+
+#include "myriota_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup GNSS_async Asynchronous GNSS fix
+/// Starts a GNSS fix and returns, so that an application job waits for the
+/// fix by returning OnGNSSFix rather than blocking in GNSSFix, e.g.
+/// \code
+/// static time_t Tracker(void) {
+///   static bool Acquiring = false;
+///   if (!Acquiring && GNSSFixStart() == 0) {
+///     Acquiring = true;
+///     return OnGNSSFix();
+///   }
+///   Acquiring = false;
+///   if (GNSSFixResult() != 0) printf("Failed to get GNSS Fix\n");
+///   ...
+/// }
+/// \endcode
+///
+/// The discrete event simulator, SIM=fast, acquires the fix while other jobs
+/// run and the module sleeps. The scheduler of the terminal library has no
+/// GNSS event, so there GNSSFixStart gets the fix with GNSSFix before
+/// returning and jobs waiting on OnGNSSFix run straight away.
+/// gnss_async.mk links the implementation into the application.
+/// @{
+
+/// Start getting a time and location fix from GNSS, as GNSSFix does.
+/// Returns 0 if started, or if a fix is already being acquired, and -1
+/// otherwise.
+int GNSSFixStart(void);
+/// Event of the fix started by GNSSFixStart being obtained or failing
+time_t OnGNSSFix(void);
+/// Returns 0 if the fix started by GNSSFixStart was obtained and -1 if it
+/// failed or is still being acquired.
+int GNSSFixResult(void);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // GNSS_ASYNC_H
@@ -0,0 +1,23 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Links the asynchronous GNSS fix of gnss_async.h into the application.
+# Include before terminal/app.mk.
+
+include $(ROOTDIR)/terminal/component.mk
+
+GNSS_ASYNC_DIR:=$(ROOTDIR)/terminal/gnss_async
+GNSS_ASYNC_OBJ:=$(call component_object,$(GNSS_ASYNC_DIR)/gnss_async.c)
+OBJ_LIST+=$(GNSS_ASYNC_OBJ)
+-include $(GNSS_ASYNC_OBJ:.o=.d)
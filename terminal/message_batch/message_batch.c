@@ -0,0 +1,154 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "message_batch.h"
+#include <math.h>
+#include <string.h>
+#include "math/myriotamath.h"
+
+#define HEADER_BITS 13  // sequence number and record count
+#define MESSAGE_BITS (8 * MAX_MESSAGE_SIZE)
+
+static uint32_t Mask(unsigned int Bits) {
+  return Bits >= 32 ? 0xFFFFFFFF : ((uint32_t)1 << Bits) - 1;
+}
+
+static unsigned int FullBits(const MessageBatch *Batch) {
+  unsigned int bits = 0;
+  for (unsigned int f = 0; f < Batch->FieldCount; f++)
+    bits += Batch->Fields[f].Bits;
+  return bits;
+}
+
+// Bits of the smallest record after the first of a message
+static unsigned int LeastBits(const MessageBatch *Batch) {
+  unsigned int bits = Batch->Delta ? 1 : 0;
+  for (unsigned int f = 0; f < Batch->FieldCount; f++) {
+    const MessageBatchField *field = &Batch->Fields[f];
+    bits += field->DeltaBits > 0 ? field->DeltaBits : field->Bits;
+  }
+  return bits;
+}
+
+int MessageBatchInit(MessageBatch *Batch, const MessageBatchField *Fields,
+                     unsigned int FieldCount) {
+  if (FieldCount == 0 || FieldCount > MESSAGE_BATCH_MAX_FIELDS) return -1;
+  memset(Batch, 0, sizeof(*Batch));
+  for (unsigned int f = 0; f < FieldCount; f++) {
+    if (Fields[f].Bits == 0 || Fields[f].Bits > 32 ||
+        Fields[f].DeltaBits > Fields[f].Bits)
+      return -1;
+    Batch->Fields[f] = Fields[f];
+    if (Fields[f].DeltaBits > 0) Batch->Delta = true;
+  }
+  Batch->FieldCount = FieldCount;
+  if (HEADER_BITS + FullBits(Batch) > MESSAGE_BITS) return -1;
+  Batch->Bits = HEADER_BITS;
+  return 0;
+}
+
+// Differences from the previous record of the fields that have them, if they
+// all fit
+static bool Differences(const MessageBatch *Batch, const uint32_t *Values,
+                        uint32_t *Deltas) {
+  for (unsigned int f = 0; f < Batch->FieldCount; f++) {
+    const MessageBatchField *field = &Batch->Fields[f];
+    if (field->DeltaBits == 0) continue;
+    // difference modulo the field width, as a signed value of that width
+    const uint32_t d = (Values[f] - Batch->Previous[f]) & Mask(field->Bits);
+    const int64_t half = (int64_t)1 << (field->Bits - 1);
+    const int64_t s = d < half ? (int64_t)d : (int64_t)d - 2 * half;
+    const int64_t limit = (int64_t)1 << (field->DeltaBits - 1);
+    if (s < -limit || s >= limit) return false;
+    Deltas[f] = (uint32_t)s & Mask(field->DeltaBits);
+  }
+  return true;
+}
+
+// Schedule the message and start the next
+static int Schedule(MessageBatch *Batch) {
+  if (Batch->Records == 0) return 0;
+  myriota_bit_writer w;
+  myriota_bit_writer_init(&w, Batch->Message, 0);
+  myriota_bit_writer_write(&w, Batch->Sequence, 8);
+  myriota_bit_writer_write(&w, Batch->Records, 5);
+  myriota_bit_writer_flush(&w);
+  Batch->Load = ScheduleMessage(Batch->Message, (Batch->Bits + 7) / 8);
+  memset(Batch->Message, 0, sizeof(Batch->Message));
+  Batch->Bits = HEADER_BITS;
+  Batch->Records = 0;
+  Batch->Sequence++;
+  if (isnan(Batch->Load)) return -1;
+  Batch->Scheduled++;
+  return 0;
+}
+
+int MessageBatchAdd(MessageBatch *Batch, const uint32_t *Values) {
+  uint32_t deltas[MESSAGE_BATCH_MAX_FIELDS];
+  bool delta = Batch->Records > 0 && Differences(Batch, Values, deltas);
+  unsigned int bits = Batch->Records > 0 && Batch->Delta ? 1 : 0;
+  for (unsigned int f = 0; f < Batch->FieldCount; f++) {
+    const MessageBatchField *field = &Batch->Fields[f];
+    bits += delta && field->DeltaBits > 0 ? field->DeltaBits : field->Bits;
+  }
+  int result = 0;
+  if (Batch->Bits + bits > MESSAGE_BITS) {
+    result = Schedule(Batch);
+    delta = false;
+    bits = FullBits(Batch);
+  }
+
+  myriota_bit_writer w;
+  myriota_bit_writer_init(&w, Batch->Message, Batch->Bits);
+  if (Batch->Records > 0 && Batch->Delta)
+    myriota_bit_writer_write(&w, !delta, 1);
+  for (unsigned int f = 0; f < Batch->FieldCount; f++) {
+    const MessageBatchField *field = &Batch->Fields[f];
+    if (delta && field->DeltaBits > 0)
+      myriota_bit_writer_write(&w, deltas[f], field->DeltaBits);
+    else
+      myriota_bit_writer_write(&w, Values[f] & Mask(field->Bits), field->Bits);
+    Batch->Previous[f] = Values[f] & Mask(field->Bits);
+  }
+  myriota_bit_writer_flush(&w);
+  Batch->Bits += bits;
+  Batch->Records++;
+
+  // schedule straight away once no further record fits
+  if (Batch->Records == MESSAGE_BATCH_MAX_RECORDS ||
+      Batch->Bits + LeastBits(Batch) > MESSAGE_BITS)
+    result |= Schedule(Batch);
+  return result;
+}
+
+int MessageBatchFlush(MessageBatch *Batch) { return Schedule(Batch); }
+
+static MessageBatch *FlushBatch;
+static unsigned int FlushInterval;
+
+static time_t NextFlush(void) {
+  return BeforeSatelliteTransmit(SecondsFromNow(FlushInterval),
+                                 SecondsFromNow(2 * FlushInterval));
+}
+
+static time_t FlushJob(void) {
+  MessageBatchFlush(FlushBatch);
+  return NextFlush();
+}
+
+int MessageBatchScheduleFlush(MessageBatch *Batch, unsigned int Interval) {
+  FlushBatch = Batch;
+  FlushInterval = Interval;
+  return ScheduleJob(FlushJob, NextFlush());
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Batching of small records into full messages
+
+#ifndef MESSAGE_BATCH_H
+#define MESSAGE_BATCH_H
+
+#include "myriota_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup Message_batch Message batching
+/// Packs records of a few integer fields into messages of #MAX_MESSAGE_SIZE
+/// bytes, so a message carries many records rather than one and is scheduled
+/// once. Fields after the first record of a message are coded as differences
+/// from the previous record where they fit in fewer bits.
+///
+/// Messages are bit packed, most significant bit first, as
+///   |8|5|record|record|...
+///   |Sequence|Records|...
+/// where the first record is every field in its full width and the later
+/// records are a bit that is 1 for the full widths, or 0 for differences of
+/// width \p DeltaBits, followed by the fields, the bit being left out if no
+/// field has differences. Fields without differences are always in full.
+/// unpack_batch.py unpacks the messages.
+///
+/// Full messages are scheduled straight away and the partial message by
+/// MessageBatchFlush, for example from a job run before satellite transmit
+/// opportunities so that records reach the next pass:
+/// \code
+/// static const MessageBatchField Fields[] = {{16, 4}, {32, 12}, {32, 12}};
+/// static MessageBatch Batch;
+/// void AppInit() {
+///   MessageBatchInit(&Batch, Fields, 3);
+///   MessageBatchScheduleFlush(&Batch, 8 * 3600);
+///   ...
+/// }
+/// \endcode
+/// @{
+
+/// Most fields of a record
+#define MESSAGE_BATCH_MAX_FIELDS 8
+/// Most records of a message, limited by the width of the record count
+#define MESSAGE_BATCH_MAX_RECORDS 31
+
+typedef struct {
+  uint8_t Bits;       ///< width of the field, 1 to 32
+  uint8_t DeltaBits;  ///< width of differences, 0 for no differences
+} MessageBatchField;
+
+typedef struct {
+  MessageBatchField Fields[MESSAGE_BATCH_MAX_FIELDS];
+  unsigned int FieldCount;
+  bool Delta;  ///< any field has differences
+  uint8_t Message[MAX_MESSAGE_SIZE];
+  unsigned int Bits;     ///< bits of the message in use
+  unsigned int Records;  ///< records in the message
+  uint32_t Previous[MESSAGE_BATCH_MAX_FIELDS];
+  uint8_t Sequence;    ///< sequence number of the message
+  uint32_t Scheduled;  ///< messages scheduled
+  float Load;          ///< returned by the last ScheduleMessage
+} MessageBatch;
+
+/// Start a batch of records of \p FieldCount fields.
+/// Returns 0 if succeeded and -1 if the fields are invalid or too wide for a
+/// single record per message.
+int MessageBatchInit(MessageBatch *Batch, const MessageBatchField *Fields,
+                     unsigned int FieldCount);
+
+/// Add a record of a value per field, of which the low \p Bits are kept.
+/// Schedules the message when the record does not fit.
+/// Returns 0 if succeeded and -1 if ScheduleMessage failed.
+int MessageBatchAdd(MessageBatch *Batch, const uint32_t *Values);
+
+/// Schedule the partial message, if it holds records.
+/// Returns 0 if succeeded and -1 if ScheduleMessage failed.
+int MessageBatchFlush(MessageBatch *Batch);
+
+/// Schedule a job flushing \p Batch before satellite transmit opportunities
+/// at least \p Interval seconds apart. Only one batch is flushed by the job.
+/// Returns 0 if succeeded and -1 if failed.
+int MessageBatchScheduleFlush(MessageBatch *Batch, unsigned int Interval);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MESSAGE_BATCH_H
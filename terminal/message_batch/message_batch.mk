@@ -0,0 +1,30 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Links message batching into the application, with the myriotamath bit writer
+# it packs messages with, built for the application by math/build.mk. Include
+# before terminal/app.mk.
+
+include $(ROOTDIR)/terminal/component.mk
+include $(ROOTDIR)/math/build.mk
+
+MESSAGE_BATCH_DIR:=$(ROOTDIR)/terminal/message_batch
+MESSAGE_BATCH_OBJ:=$(call component_object,$(MESSAGE_BATCH_DIR)/message_batch.c)
+OBJ_LIST+=$(MESSAGE_BATCH_OBJ)
+# the C part of myriotamath, as in terminal/g2/app.mk
+MESSAGE_BATCH_MATH_OBJ:=$(filter %.c.mathlib.o,$(MATH_OBJECTS))
+ifeq ($(filter $(MESSAGE_BATCH_MATH_OBJ),$(OBJ_LIST)),)
+OBJ_LIST+=$(MESSAGE_BATCH_MATH_OBJ)
+endif
+-include $(MESSAGE_BATCH_OBJ:.o=.d)
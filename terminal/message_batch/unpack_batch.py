@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Unpacker for messages of message_batch.c. Fields are given in the order of
+# the MessageBatchField array as bits[:delta bits], with an s after the bits
+# for fields that are signed.
+# Usage:
+# unpack_batch.py -f 16:4,32s:12,32s:12 -x 0528...
+# or
+# echo "0528..." | unpack_batch.py -f 16:4,32s:12,32s:12
+
+import argparse
+import fileinput
+import json
+
+
+def parse_fields(spec):
+    fields = []
+    for f in spec.split(','):
+        bits, _, delta = f.partition(':')
+        signed = bits.endswith('s')
+        bits = int(bits.rstrip('s'))
+        delta = int(delta) if delta else 0
+        if not 0 < bits <= 32 or not 0 <= delta <= bits:
+            raise ValueError("Invalid field " + f)
+        fields.append((bits, delta, signed))
+    return fields
+
+
+class BitReader(object):
+    def __init__(self, packet):
+        self.value = int(packet, 16) if packet else 0
+        self.size = 4 * len(packet)
+        self.position = 0
+
+    def read(self, bits):
+        self.position += bits
+        if self.position > self.size:
+            raise ValueError("Message too short")
+        return (self.value >> (self.size - self.position)) & ((1 << bits) - 1)
+
+
+def signed(value, bits):
+    return value - (1 << bits) if value >= 1 << (bits - 1) else value
+
+
+def unpack(packet, fields):
+    bytearray.fromhex(packet)  # check the packet is hexadecimal
+    r = BitReader(packet)
+    sequence = r.read(8)
+    count = r.read(5)
+    has_delta = any(delta > 0 for _, delta, _ in fields)
+    previous = None
+    records = []
+    for i in range(count):
+        full = previous is None or not has_delta or r.read(1) == 1
+        values = []
+        for f, (bits, delta, is_signed) in enumerate(fields):
+            if full or delta == 0:
+                v = r.read(bits)
+            else:
+                v = (previous[f] + signed(r.read(delta), delta)) & \
+                    ((1 << bits) - 1)
+            values.append(v)
+        previous = values
+        records.append({'Sequence number': sequence, 'Record': i,
+                        'Values': [signed(v, b) if s else v for v, (b, _, s)
+                                   in zip(values, fields)]})
+    return records
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Unpack hexadecimal messages of message_batch.c.",
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('-f', '--fields', type=str, required=True,
+                        help='Fields as bits[:delta bits], s for signed')
+    parser.add_argument('-x', '--hex', type=str, default="-",
+                        help='Packet data in hexadecimal format')
+    args = parser.parse_args()
+    fields = parse_fields(args.fields)
+
+    d = []
+    if args.hex == "-":
+        for line in fileinput.input('-'):
+            if line.strip():
+                d = d + unpack(line.strip(), fields)
+    else:
+        d = d + unpack(args.hex, fields)
+
+    print(json.dumps(d))
@@ -0,0 +1,123 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pass_table.h"
+#include <string.h>
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Tables are read in place in native byte order, which is little endian on
+// the terminals and the hosts running the simulators
+int PassTableInit(PassTable *Table, const void *Data, size_t Size) {
+  const PassTableHeader *h = Data;
+  if (Data == NULL || ((uintptr_t)Data & 3) != 0 || Size < sizeof(*h) ||
+      memcmp(h->Magic, PASS_TABLE_MAGIC, sizeof(h->Magic)) != 0 ||
+      h->Rows == 0 || h->Cols == 0 || h->End < h->Start)
+    return -1;
+  const uint64_t cells = (uint64_t)h->Rows * h->Cols;
+  if (cells + 1 + h->Count > (Size - sizeof(*h)) / sizeof(uint32_t)) return -1;
+  const uint32_t *offsets = (const uint32_t *)(h + 1);
+  if (offsets[0] != 0 || offsets[cells] != h->Count) return -1;
+  for (uint64_t c = 0; c < cells; c++)
+    if (offsets[c + 1] < offsets[c]) return -1;
+  Table->Header = h;
+  Table->Offsets = offsets;
+  Table->Times = offsets + cells + 1;
+  Table->Mapping = NULL;
+  Table->Size = Size;
+  return 0;
+}
+
+uint32_t PassTableCell(const PassTable *Table, int32_t Latitude,
+                       int32_t Longitude) {
+  const uint32_t rows = Table->Header->Rows, cols = Table->Header->Cols;
+  uint64_t row = ((int64_t)Latitude + 900000000) * rows / 1800000000;
+  uint64_t col = ((int64_t)Longitude + 1800000000) * cols / 3600000000;
+  if (Latitude < -900000000) row = 0;
+  if (row >= rows) row = rows - 1;
+  if (Longitude < -1800000000) col = 0;
+  if (col >= cols) col = 0;  // longitude 180 is -180
+  return row * cols + col;
+}
+
+int PassTableBeforeSatelliteTransmit(const PassTable *Table, int32_t Latitude,
+                                     int32_t Longitude, time_t After,
+                                     time_t Before, time_t *Time) {
+  const PassTableHeader *h = Table->Header;
+  if (After < h->Start || After >= h->End) return -1;
+  const uint32_t c = PassTableCell(Table, Latitude, Longitude);
+  // first time at or after After
+  uint32_t lo = Table->Offsets[c], hi = Table->Offsets[c + 1];
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if (Table->Times[mid] < After)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < Table->Offsets[c + 1] && Table->Times[lo] < Before) {
+    *Time = Table->Times[lo];
+    return 0;
+  }
+  // no later time in the table is only an answer up to the end of the table
+  if (lo == Table->Offsets[c + 1] && Before > h->End) return -1;
+  *Time = Before;
+  return 0;
+}
+
+#if defined(__unix__)
+int PassTableWrite(FILE *File, uint32_t Rows, uint32_t Cols, uint32_t Start,
+                   uint32_t End, const uint32_t *Offsets,
+                   const uint32_t *Times) {
+  const size_t cells = (size_t)Rows * Cols;
+  PassTableHeader h = {.Rows = Rows,
+                       .Cols = Cols,
+                       .Start = Start,
+                       .End = End,
+                       .Count = Offsets[cells]};
+  memcpy(h.Magic, PASS_TABLE_MAGIC, sizeof(h.Magic));
+  if (fwrite(&h, sizeof(h), 1, File) != 1 ||
+      fwrite(Offsets, sizeof(uint32_t), cells + 1, File) != cells + 1 ||
+      fwrite(Times, sizeof(uint32_t), h.Count, File) != h.Count)
+    return -1;
+  return 0;
+}
+
+int PassTableMap(PassTable *Table, const char *Path) {
+  const int fd = open(Path, O_RDONLY);
+  if (fd < 0) return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return -1;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return -1;
+  if (PassTableInit(Table, p, st.st_size) != 0) {
+    munmap(p, st.st_size);
+    return -1;
+  }
+  Table->Mapping = p;
+  return 0;
+}
+
+void PassTableUnmap(PassTable *Table) {
+  if (Table->Mapping != NULL) munmap(Table->Mapping, Table->Size);
+  Table->Mapping = NULL;
+}
+#endif
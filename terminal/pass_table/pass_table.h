@@ -0,0 +1,107 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Precomputed table of satellite transmit opportunities
+
+#ifndef PASS_TABLE_H
+#define PASS_TABLE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup Pass_table Satellite pass table
+/// Times returned by BeforeSatelliteTransmit, precomputed on a grid of
+/// locations over a range of time by pass_table_gen, so they can be looked up
+/// in O(log n) rather than propagating orbits. The table is a single block of
+/// memory, either linked into the application with pass_table.mk or memory
+/// mapped from a file on the host.
+///
+/// Layout, little endian: a #PassTableHeader, then the offset of the first
+/// time of each of the Rows * Cols cells plus the total count, as uint32_t,
+/// then the sorted times of every cell in turn, as uint32_t epoch seconds.
+/// Cells are ordered by row from latitude -90 and then by column from
+/// longitude -180.
+/// @{
+
+#define PASS_TABLE_MAGIC "MYRPASS1"
+
+typedef struct {
+  char Magic[8];
+  uint32_t Rows;   ///< cells in latitude
+  uint32_t Cols;   ///< cells in longitude
+  uint32_t Start;  ///< table covers times from Start
+  uint32_t End;    ///< up to End
+  uint32_t Count;  ///< total number of times
+  uint32_t Reserved;
+} PassTableHeader;
+
+typedef struct {
+  const PassTableHeader *Header;
+  const uint32_t *Offsets;
+  const uint32_t *Times;
+  void *Mapping;  ///< set by PassTableMap
+  size_t Size;
+} PassTable;
+
+/// Check and open a table held in \p Size bytes at \p Data.
+/// Returns 0 if succeeded and -1 if the table is invalid.
+int PassTableInit(PassTable *Table, const void *Data, size_t Size);
+
+/// Index of the cell holding a location, in degrees multiplied by 1e7.
+uint32_t PassTableCell(const PassTable *Table, int32_t Latitude,
+                       int32_t Longitude);
+
+/// Approximates BeforeSatelliteTransmit for a module at a location, in degrees
+/// multiplied by 1e7. Writes the first time in the table at or after \p After
+/// if it is before \p Before, and \p Before otherwise, to \p Time. The table
+/// holds the times at the centre of the cell, each searched for
+/// PASS_TABLE_SPACING seconds (600 by default) after the one before, so a time
+/// found is never earlier than BeforeSatelliteTransmit at the cell centre and
+/// can be up to that spacing later. Locations away from the centre differ
+/// further, by how the passes change across the PASS_TABLE_CELL degrees of a
+/// cell.
+/// Returns 0 if succeeded and -1 if the table does not cover the times
+/// between \p After and \p Before.
+int PassTableBeforeSatelliteTransmit(const PassTable *Table, int32_t Latitude,
+                                     int32_t Longitude, time_t After,
+                                     time_t Before, time_t *Time);
+
+/// Table linked into the application by pass_table.mk, \p Size bytes long
+const uint8_t *BuiltinPassTableGet(size_t *Size);
+
+#if defined(__unix__)
+/// Write a table from the times of every cell, \p Offsets as in the layout.
+/// Returns 0 if succeeded and -1 if failed.
+int PassTableWrite(FILE *File, uint32_t Rows, uint32_t Cols, uint32_t Start,
+                   uint32_t End, const uint32_t *Offsets,
+                   const uint32_t *Times);
+/// Memory map a table file read-only.
+/// Returns 0 if succeeded and -1 if failed.
+int PassTableMap(PassTable *Table, const char *Path);
+/// Unmap a table opened by PassTableMap.
+void PassTableUnmap(PassTable *Table);
+#endif
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PASS_TABLE_H
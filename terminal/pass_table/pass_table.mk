@@ -0,0 +1,40 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Links the pass table file PASS_TABLE, made by pass_table_gen, into the
+# application, so BuiltinPassTableGet returns it for PassTableInit. Include
+# before terminal/app.mk.
+
+ifndef PASS_TABLE
+$(error PASS_TABLE is not set, see pass_table_gen)
+endif
+
+include $(ROOTDIR)/terminal/component.mk
+
+PASS_TABLE_DIR:=$(ROOTDIR)/terminal/pass_table
+PASS_TABLE_OBJ:=$(call component_object,$(PASS_TABLE_DIR)/pass_table.c)
+pass_table:=$(shell mktemp)
+ifeq ($(filter $(PASS_TABLE_OBJ),$(OBJ_LIST)),)
+OBJ_LIST+=$(PASS_TABLE_OBJ)
+endif
+-include $(PASS_TABLE_OBJ:.o=.d)
+OBJ_LIST+=$(pass_table).o
+
+# create pass_table.c source holding the table, aligned for reading in place
+$(pass_table).c: $(PASS_TABLE)
+	printf "#include <stddef.h>\n#include <inttypes.h>\n" > $@
+	printf "const uint8_t *BuiltinPassTableGet(size_t *Size) { " >> $@
+	printf "static const uint8_t b[] __attribute__((aligned(4))) = {" >> $@
+	xxd -i < $(PASS_TABLE) | tr -d \\n >> $@
+	printf "}; *Size = sizeof(b); return b; }" >> $@
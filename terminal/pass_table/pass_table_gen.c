@@ -0,0 +1,80 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates a pass table by walking BeforeSatelliteTransmit of the simulator,
+// and so its orbit model, at the centre of every cell of a grid. Runs as an
+// application on a sim platform and is configured by the environment:
+//   PASS_TABLE_FILE     output file (default pass_table.bin)
+//   PASS_TABLE_DAYS     days covered from the current time (default 30)
+//   PASS_TABLE_CELL     degrees per cell (default 10)
+//   PASS_TABLE_SPACING  seconds from one transmit time to the search for the
+//                       next (default 600)
+
+#include <stdlib.h>
+#include "myriota_user_api.h"
+#include "pass_table.h"
+
+static unsigned int Setting(const char *Name, unsigned int Default) {
+  const char *s = getenv(Name);
+  return s != NULL && atoi(s) > 0 ? atoi(s) : Default;
+}
+
+static time_t Generate(void) {
+  const char *path = getenv("PASS_TABLE_FILE");
+  if (path == NULL) path = "pass_table.bin";
+  const unsigned int cell = Setting("PASS_TABLE_CELL", 10);
+  const unsigned int spacing = Setting("PASS_TABLE_SPACING", 600);
+  const time_t start = TimeGet();
+  const time_t end = start + 86400 * (time_t)Setting("PASS_TABLE_DAYS", 30);
+  const uint32_t rows = (180 + cell - 1) / cell, cols = (360 + cell - 1) / cell;
+
+  uint32_t *offsets = malloc((rows * cols + 1) * sizeof(uint32_t));
+  uint32_t *times = NULL;
+  size_t count = 0, capacity = 0;
+  if (offsets == NULL) exit(EXIT_FAILURE);
+  for (uint32_t c = 0; c < rows * cols; c++) {
+    offsets[c] = count;
+    const double latitude = -90 + 180.0 * (c / cols + 0.5) / rows;
+    const double longitude = -180 + 360.0 * (c % cols + 0.5) / cols;
+    LocationSet(latitude * 1e7, longitude * 1e7);
+    time_t after = start;
+    while (true) {
+      const time_t t = BeforeSatelliteTransmit(after, end);
+      if (t >= end) break;
+      if (count == capacity) {
+        capacity = capacity ? 2 * capacity : 4096;
+        times = realloc(times, capacity * sizeof(uint32_t));
+        if (times == NULL) exit(EXIT_FAILURE);
+      }
+      times[count++] = t;
+      after = (t > after ? t : after) + spacing;
+    }
+  }
+  offsets[rows * cols] = count;
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL ||
+      PassTableWrite(f, rows, cols, start, end, offsets, times) != 0 ||
+      fclose(f) != 0) {
+    printf("Failed to write %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  printf("Wrote %u transmit times of %u cells to %s\n", (unsigned int)count,
+         (unsigned int)(rows * cols), path);
+  free(offsets);
+  free(times);
+  exit(EXIT_SUCCESS);
+  return Never();
+}
+
+void AppInit() { ScheduleJob(Generate, ASAP()); }
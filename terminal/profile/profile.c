@@ -0,0 +1,185 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Wrappers of the user API linked in with -Wl,--wrap by profile.mk, so calls
+// of the application to a function f go to __wrap_f, which calls __real_f.
+
+#include "profile.h"
+#include <string.h>
+
+#define NO_JOB 0xFF
+
+int __real_ScheduleJob(ScheduledJob Job, time_t Time);
+int __real_GNSSFix(void);
+void __real_Delay(uint32_t mSec);
+void __real_Sleep(uint32_t Sec);
+
+static struct {
+  ScheduledJob Jobs[PROFILE_MAX_JOBS];
+  ProfileJobCounters Counters[PROFILE_MAX_JOBS];
+  unsigned int JobCount;
+  ProfileGNSSCounters GNSS;
+  ProfileDelayCounters Delay;
+  ProfileEvent Ring[PROFILE_RING_SIZE];
+  unsigned int Events;  // added to the ring since the reset
+  uint8_t Running;      // wrapper of the job running
+  bool HasEnded;
+  uint32_t LastEnd;  // tick at the end of the last run
+} Profile = {.Running = NO_JOB};
+
+static void AddEvent(ProfileEventKind Kind, time_t Time, uint32_t Ticks) {
+  ProfileEvent *e = &Profile.Ring[Profile.Events % PROFILE_RING_SIZE];
+  e->Time = Time;
+  e->Ticks = Ticks;
+  e->Kind = Kind;
+  e->Job = Profile.Running;
+  e->Reserved = 0;
+  Profile.Events++;
+}
+
+static time_t Run(unsigned int Job) {
+  ProfileJobCounters *c = &Profile.Counters[Job];
+  const time_t time = TimeGet();
+  const uint32_t start = TickGet();
+  if (!Profile.HasEnded || start - Profile.LastEnd > PROFILE_WAKEUP_TICKS)
+    c->Wakeups++;
+  const uint8_t outer = Profile.Running;
+  Profile.Running = Job;
+  const time_t next = Profile.Jobs[Job]();
+  Profile.LastEnd = TickGet();
+  Profile.HasEnded = true;
+  const uint32_t ticks = Profile.LastEnd - start;
+  c->Runs++;
+  c->Ticks += ticks;
+  if (ticks > c->MaxTicks) c->MaxTicks = ticks;
+  AddEvent(PROFILE_EVENT_JOB, time, ticks);
+  Profile.Running = outer;
+  return next;
+}
+
+// Job functions take no arguments, so every wrapper is its own function
+#define WRAPPER(n) \
+  static time_t Wrapper##n(void) { return Run(n); }
+WRAPPER(0)
+WRAPPER(1)
+WRAPPER(2)
+WRAPPER(3)
+WRAPPER(4)
+WRAPPER(5)
+WRAPPER(6)
+WRAPPER(7)
+WRAPPER(8)
+WRAPPER(9)
+WRAPPER(10)
+WRAPPER(11)
+WRAPPER(12)
+WRAPPER(13)
+WRAPPER(14)
+WRAPPER(15)
+#undef WRAPPER
+
+static const ScheduledJob Wrappers[PROFILE_MAX_JOBS] = {
+    Wrapper0,  Wrapper1,  Wrapper2,  Wrapper3, Wrapper4,  Wrapper5,
+    Wrapper6,  Wrapper7,  Wrapper8,  Wrapper9, Wrapper10, Wrapper11,
+    Wrapper12, Wrapper13, Wrapper14, Wrapper15};
+
+int __wrap_ScheduleJob(ScheduledJob Job, time_t Time) {
+  unsigned int i = 0;
+  while (i < Profile.JobCount && Profile.Jobs[i] != Job) i++;
+  if (i == Profile.JobCount) {
+    if (i == PROFILE_MAX_JOBS) return __real_ScheduleJob(Job, Time);
+    Profile.Jobs[i] = Job;
+    Profile.Counters[i].Job = i;
+    Profile.Counters[i].Address = (uintptr_t)Job;
+    Profile.JobCount++;
+  }
+  return __real_ScheduleJob(Wrappers[i], Time);
+}
+
+int __wrap_GNSSFix(void) {
+  const time_t time = TimeGet();
+  const uint32_t start = TickGet();
+  const int result = __real_GNSSFix();
+  const uint32_t ticks = TickGet() - start;
+  Profile.GNSS.Fixes++;
+  if (result != 0) Profile.GNSS.Failures++;
+  Profile.GNSS.Ticks += ticks;
+  if (ticks > Profile.GNSS.MaxTicks) Profile.GNSS.MaxTicks = ticks;
+  AddEvent(PROFILE_EVENT_GNSS, time, ticks);
+  return result;
+}
+
+void __wrap_Delay(uint32_t mSec) {
+  AddEvent(PROFILE_EVENT_DELAY, TimeGet(), mSec);
+  Profile.Delay.Delays++;
+  Profile.Delay.DelayTicks += mSec;
+  __real_Delay(mSec);
+}
+
+void __wrap_Sleep(uint32_t Sec) {
+  AddEvent(PROFILE_EVENT_SLEEP, TimeGet(), 1000 * Sec);
+  Profile.Delay.Sleeps++;
+  Profile.Delay.SleepSeconds += Sec;
+  __real_Sleep(Sec);
+}
+
+const ProfileJobCounters *ProfileJobGet(unsigned int Job) {
+  return Job < Profile.JobCount ? &Profile.Counters[Job] : NULL;
+}
+
+const ProfileGNSSCounters *ProfileGNSSGet(void) { return &Profile.GNSS; }
+
+const ProfileDelayCounters *ProfileDelayGet(void) { return &Profile.Delay; }
+
+unsigned int ProfileEventsGet(ProfileEvent *Events, unsigned int Count) {
+  const unsigned int held = Profile.Events < PROFILE_RING_SIZE
+                                ? Profile.Events
+                                : PROFILE_RING_SIZE;
+  if (Count > held) Count = held;
+  for (unsigned int i = 0; i < Count; i++)
+    Events[i] = Profile.Ring[(Profile.Events - Count + i) % PROFILE_RING_SIZE];
+  return Count;
+}
+
+void ProfileReset(void) {
+  for (unsigned int i = 0; i < Profile.JobCount; i++) {
+    const uint32_t address = Profile.Counters[i].Address;
+    memset(&Profile.Counters[i], 0, sizeof(Profile.Counters[i]));
+    Profile.Counters[i].Job = i;
+    Profile.Counters[i].Address = address;
+  }
+  memset(&Profile.GNSS, 0, sizeof(Profile.GNSS));
+  memset(&Profile.Delay, 0, sizeof(Profile.Delay));
+  Profile.Events = 0;
+}
+
+int ProfileDump(bool Reset) {
+  int result = 0;
+  for (unsigned int i = 0; i < Profile.JobCount; i++)
+    result |= LogAdd(PROFILE_LOG_JOB, &Profile.Counters[i],
+                     sizeof(Profile.Counters[i]));
+  result |= LogAdd(PROFILE_LOG_GNSS, &Profile.GNSS, sizeof(Profile.GNSS));
+  result |= LogAdd(PROFILE_LOG_DELAY, &Profile.Delay, sizeof(Profile.Delay));
+  ProfileEvent events[PROFILE_RING_SIZE];
+  const unsigned int count = ProfileEventsGet(events, PROFILE_RING_SIZE);
+  for (unsigned int i = 0; i < count; i += PROFILE_EVENTS_PER_LOG) {
+    // the last entry is padded with events of kind zero
+    ProfileEvent entry[PROFILE_EVENTS_PER_LOG] = {{0}};
+    for (unsigned int j = 0; j < PROFILE_EVENTS_PER_LOG && i + j < count; j++)
+      entry[j] = events[i + j];
+    result |= LogAdd(PROFILE_LOG_EVENTS, entry, sizeof(entry));
+  }
+  if (Reset) ProfileReset();
+  return result != 0 ? -1 : 0;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Profiling of jobs, GNSS fixes and delays
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "myriota_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup Profile Profiling
+/// Counters of the time spent by the application, for finding what drains
+/// the battery. profile.mk wraps ScheduleJob, GNSSFix, Delay and Sleep at link
+/// time, so applications are profiled without changes to their code:
+/// scheduled jobs run through one of #PROFILE_MAX_JOBS wrappers that count
+/// their runs and their run time in ticks of TickGet, and GNSS fixes, delays
+/// and sleeps are counted and timed too. The latest #PROFILE_RING_SIZE of
+/// these are also kept in a ring of events. Jobs scheduled once the wrappers
+/// are used up are not profiled.
+///
+/// ProfileDump writes the counters to the log with LogAdd under the user
+/// error codes from #PROFILE_LOG_CODE, which log-util.py and log_decoder
+/// decode with their --profile option. User codes belong to the application,
+/// so an application linking profile.mk must leave these codes to it.
+/// @{
+
+#define PROFILE_MAX_JOBS 16
+#define PROFILE_RING_SIZE 32
+/// Runs starting more than this many ticks after another ended are wakeups
+#define PROFILE_WAKEUP_TICKS 10
+
+/// User error codes of LogAdd, for the counters of a job, of GNSS fixes, of
+/// delays and sleeps, and for #PROFILE_EVENTS_PER_LOG events of the ring.
+/// PROFILE_LOG_CODE is defined in the table the tools decode them with.
+#define LOG_CODE(code, ...)
+#include "tools/profile_log_codes.h"
+#undef LOG_CODE
+#define PROFILE_LOG_JOB (PROFILE_LOG_CODE + 0)
+#define PROFILE_LOG_GNSS (PROFILE_LOG_CODE + 1)
+#define PROFILE_LOG_DELAY (PROFILE_LOG_CODE + 2)
+#define PROFILE_LOG_EVENTS (PROFILE_LOG_CODE + 3)
+#define PROFILE_EVENTS_PER_LOG 4
+
+typedef struct {
+  uint32_t Job;       ///< index of the wrapper
+  uint32_t Address;   ///< of the job function, as in map.out
+  uint32_t Runs;
+  uint32_t Wakeups;   ///< runs that woke the module
+  uint32_t Ticks;     ///< total run time
+  uint32_t MaxTicks;  ///< longest run
+} ProfileJobCounters;
+
+typedef struct {
+  uint32_t Fixes;
+  uint32_t Failures;
+  uint32_t Ticks;  ///< total time of fixes, including failures
+  uint32_t MaxTicks;
+} ProfileGNSSCounters;
+
+typedef struct {
+  uint32_t Delays;
+  uint32_t DelayTicks;  ///< milliseconds of Delay
+  uint32_t Sleeps;
+  uint32_t SleepSeconds;
+} ProfileDelayCounters;
+
+typedef enum {
+  PROFILE_EVENT_JOB = 1,
+  PROFILE_EVENT_GNSS = 2,
+  PROFILE_EVENT_DELAY = 3,
+  PROFILE_EVENT_SLEEP = 4
+} ProfileEventKind;
+
+typedef struct {
+  uint32_t Time;   ///< epoch time at the start
+  uint32_t Ticks;  ///< duration
+  uint8_t Kind;    ///< #ProfileEventKind
+  uint8_t Job;     ///< job wrapper, or of the job running, 0xFF if none
+  uint16_t Reserved;
+} ProfileEvent;
+
+/// Counters of the job scheduled with wrapper \p Job, or NULL if not used
+const ProfileJobCounters *ProfileJobGet(unsigned int Job);
+const ProfileGNSSCounters *ProfileGNSSGet(void);
+const ProfileDelayCounters *ProfileDelayGet(void);
+
+/// Copy up to \p Count of the latest events, oldest first, to \p Events.
+/// Returns the number copied.
+unsigned int ProfileEventsGet(ProfileEvent *Events, unsigned int Count);
+
+/// Zero the counters and empty the ring. Jobs keep their wrappers.
+void ProfileReset(void);
+
+/// Write the counters of every job, of GNSS fixes and of delays, then the
+/// ring of events, to the log. Resets the counters if \p Reset.
+/// Returns 0 if succeeded and -1 if LogAdd failed.
+int ProfileDump(bool Reset);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PROFILE_H
@@ -0,0 +1,28 @@
+# Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+# Profiles the application, see profile.h. Include after terminal/app.mk, as
+# the linker flags of the platforms are set there.
+
+include $(ROOTDIR)/terminal/component.mk
+
+PROFILE_DIR:=$(ROOTDIR)/terminal/profile
+PROFILE_OBJ:=$(call component_object,$(PROFILE_DIR)/profile.c)
+OBJ_LIST+=$(PROFILE_OBJ)
+-include $(PROFILE_OBJ:.o=.d)
+LDFLAGS+=-Wl,--wrap=ScheduleJob -Wl,--wrap=GNSSFix -Wl,--wrap=Delay \
+	-Wl,--wrap=Sleep
+
+# the programs are linked from OBJ_LIST, which app.mk has already read
+$(PROGRAM_NAME) $(PROGRAM_NAME_ELF): $(PROFILE_OBJ)
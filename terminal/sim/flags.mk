@@ -15,4 +15,4 @@
 ##Default c compiler and flags
 CC = gcc
 CFLAGS = -std=gnu99 -g -Wall -Werror -I$(ROOTDIR) -I$(ROOTDIR)/terminal/include -I. -I$(ROOTDIR)/terminal/$(PLATFORM)/include -DDEBUG
-LDFLAGS = -lm -lcrypto -Wall -Werror -fdata-sections -ffunction-sections
+LDFLAGS = -lm -lcrypto -pthread -Wall -Werror -fdata-sections -ffunction-sections
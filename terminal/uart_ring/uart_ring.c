@@ -0,0 +1,80 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "uart_ring.h"
+
+int UARTRingInit(UARTRing *Ring, void *Handle, uint8_t *Buffer, size_t Size,
+                 size_t Watermark) {
+  if (Size == 0 || (Size & (Size - 1)) != 0) return -1;
+  Ring->Handle = Handle;
+  Ring->Buffer = Buffer;
+  Ring->Size = Size;
+  Ring->Watermark = Watermark;
+  Ring->Head = Ring->Tail = 0;
+  Ring->Overflows = 0;
+  return 0;
+}
+
+size_t UARTRingAvailable(const UARTRing *Ring) {
+  return Ring->Head - Ring->Tail;
+}
+
+int UARTRingFill(UARTRing *Ring) {
+  if (UARTRingAvailable(Ring) == Ring->Size) {
+    Ring->Overflows++;
+    return 0;
+  }
+  int total = 0;
+  while (true) {
+    const size_t free = Ring->Size - UARTRingAvailable(Ring);
+    if (free == 0) break;  // filled exactly, any bytes left are read next time
+    // the free bytes up to the end of the buffer
+    const size_t head = Ring->Head & (Ring->Size - 1);
+    const size_t n = free < Ring->Size - head ? free : Ring->Size - head;
+    const int r = UARTRead(Ring->Handle, Ring->Buffer + head, n);
+    if (r < 0) return -1;
+    Ring->Head += r;
+    total += r;
+    if ((size_t)r < n) break;  // the input buffer is empty
+  }
+  return total;
+}
+
+size_t UARTRingPeek(const UARTRing *Ring, const uint8_t **Data) {
+  const size_t tail = Ring->Tail & (Ring->Size - 1);
+  const size_t available = UARTRingAvailable(Ring);
+  *Data = Ring->Buffer + tail;
+  return available < Ring->Size - tail ? available : Ring->Size - tail;
+}
+
+void UARTRingConsume(UARTRing *Ring, size_t Length) {
+  const size_t available = UARTRingAvailable(Ring);
+  Ring->Tail += Length < available ? Length : available;
+}
+
+static UARTRing *ReceiveRing;
+static ScheduledJob ReceiveJob;
+
+static time_t Receive(void) {
+  UARTRingFill(ReceiveRing);
+  if (UARTRingAvailable(ReceiveRing) >= ReceiveRing->Watermark)
+    ScheduleJob(ReceiveJob, ASAP());
+  return OnLeuartReceive();
+}
+
+int UARTRingScheduleReceive(UARTRing *Ring, ScheduledJob Job) {
+  ReceiveRing = Ring;
+  ReceiveJob = Job;
+  return ScheduleJob(Receive, OnLeuartReceive());
+}
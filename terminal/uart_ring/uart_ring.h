@@ -0,0 +1,87 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Receive ring buffers of UART interfaces
+
+#ifndef UART_RING_H
+#define UART_RING_H
+
+#include "myriota_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @defgroup UART_ring UART receive ring
+/// Drains the 50 byte input buffer of a UART interface into a larger ring, so
+/// that bytes are not lost while jobs run long, and gives access to the
+/// received bytes in place for processing in batches. UARTRingFill reads
+/// straight into the free part of the ring, in as few UARTRead calls as the
+/// interface has bytes for. UARTRingPeek and UARTRingConsume read the ring
+/// without copying, e.g.
+/// \code
+/// const uint8_t *Data;
+/// size_t Length;
+/// while ((Length = UARTRingPeek(&Ring, &Data)) > 0) {
+///   Process(Data, Length);
+///   UARTRingConsume(&Ring, Length);
+/// }
+/// \endcode
+///
+/// UARTRingScheduleReceive fills the ring of a LEUART interface on its receive
+/// events and runs a job once the ring holds a watermark of bytes. Rings of
+/// other interfaces are filled by calling UARTRingFill often enough that the
+/// input buffer does not overflow.
+/// @{
+
+typedef struct {
+  void *Handle;        ///< of UARTInit
+  uint8_t *Buffer;
+  size_t Size;         ///< power of two
+  size_t Watermark;    ///< bytes held for UARTRingScheduleReceive
+  size_t Head;         ///< bytes written, modulo SIZE_MAX + 1
+  size_t Tail;         ///< bytes consumed
+  uint32_t Overflows;  ///< fills that found the ring already full
+} UARTRing;
+
+/// Start a ring on the UART interface of \p Handle, held in the \p Size
+/// bytes of \p Buffer.
+/// Returns 0 if succeeded and -1 if \p Size is not a power of two.
+int UARTRingInit(UARTRing *Ring, void *Handle, uint8_t *Buffer, size_t Size,
+                 size_t Watermark);
+/// Read the bytes received by the interface into the ring.
+/// Returns the number of bytes read and -1 if UARTRead failed.
+int UARTRingFill(UARTRing *Ring);
+/// Number of bytes in the ring
+size_t UARTRingAvailable(const UARTRing *Ring);
+/// Point \p Data to the oldest bytes in the ring.
+/// Returns the number of bytes at \p Data, which is less than
+/// UARTRingAvailable when the bytes wrap around the end of the buffer.
+size_t UARTRingPeek(const UARTRing *Ring, const uint8_t **Data);
+/// Remove the \p Length oldest bytes, at most UARTRingAvailable.
+void UARTRingConsume(UARTRing *Ring, size_t Length);
+
+/// Schedule a job filling \p Ring on receive events of the LEUART interface,
+/// which runs \p Job as soon as the ring holds the watermark. Only one ring is
+/// filled by the job.
+/// Returns 0 if succeeded and -1 if failed.
+int UARTRingScheduleReceive(UARTRing *Ring, ScheduledJob Job);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // UART_RING_H
@@ -0,0 +1,469 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for myriotamath. Results are written to stdout as JSON, one
+// object per benchmark, so runs from different SDK releases can be compared.
+//
+// Inputs are generated from a fixed seed. Each benchmark runs its kernel
+// repeatedly until min_time seconds have elapsed, and this is repeated
+// several times. The median time per iteration is reported along with the
+// fastest, which is usually the more stable figure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "math/myriotamath.h"
+#include "tools/cmdline.h"
+
+#ifndef MYRIOTA_SDK_VERSION
+#define MYRIOTA_SDK_VERSION "unknown"
+#endif
+
+using namespace myriota;
+
+struct Options {
+  double min_time;
+  unsigned int repetitions;
+  std::string filter;
+};
+
+struct Result {
+  std::string name;
+  std::string params;  // JSON object members, e.g. "\"N\": 1024"
+  uint64_t iterations;
+  double median;  // seconds per iteration
+  double best;
+  double items;  // items per iteration, e.g. samples
+  std::string unit;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Time f, which processes items units per call
+static bool run(const Options &options, std::vector<Result> &results,
+                const std::string &name, const std::string &params,
+                double items, const std::string &unit,
+                const std::function<void()> &f) {
+  if (name.find(options.filter) == std::string::npos) return false;
+  f();  // warm up caches and any lazily built state
+  uint64_t iterations = 1;
+  std::vector<double> times;
+  for (unsigned int r = 0; r < options.repetitions; r++) {
+    while (true) {
+      const auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < iterations; i++) f();
+      const double elapsed = seconds_since(start);
+      if (elapsed >= options.min_time) {
+        times.push_back(elapsed / iterations);
+        break;
+      }
+      // aim a little past min_time from the measured rate
+      iterations = std::max<uint64_t>(
+          2 * iterations, 1.2 * options.min_time * iterations /
+                              std::max(elapsed, 1e-9));
+    }
+  }
+  std::sort(times.begin(), times.end());
+  const Result result = {name,     params,         iterations,
+                         times[times.size() / 2], times[0], items, unit};
+  results.push_back(result);
+  fprintf(stderr, "%-28s %-40s %12.4g %s/s\n", name.c_str(), params.c_str(),
+          items / result.best, unit.c_str());
+  return true;
+}
+
+static std::string param(const std::string &key, double value) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "\"%s\": %.10g", key.c_str(), value);
+  return buf;
+}
+
+static std::string params(const std::string &a, const std::string &b = "",
+                          const std::string &c = "") {
+  std::string s = a;
+  if (!b.empty()) s += ", " + b;
+  if (!c.empty()) s += ", " + c;
+  return s;
+}
+
+static std::vector<complex> random_samples(size_t n) {
+  std::vector<complex> x(n);
+  for (size_t i = 0; i < n; i++)
+    x[i] = complex(myriota_random_normal(), myriota_random_normal());
+  return x;
+}
+
+static std::vector<uint8_t> random_bytes(size_t n) {
+  std::vector<uint8_t> b(n);
+  for (size_t i = 0; i < n; i++) b[i] = rand();
+  return b;
+}
+
+struct Ratio {
+  double in_rate;
+  double out_rate;
+};
+
+// Rate ratios used by the satellite simulator and common audio conversions
+static const Ratio ratios[] = {
+    {250e3, 5e3}, {48e3, 44.1e3}, {44.1e3, 48e3}, {5e3, 250e3}};
+static const double widths[] = {10, 30};
+
+// Per sample push and evaluation, as done by callers of Upsampler and
+// Downsampler
+template <typename R>
+static void bench_per_sample(const Options &options,
+                             std::vector<Result> &results,
+                             const std::string &name, const Ratio &ratio,
+                             double W) {
+  const size_t n = 1 << 14;
+  const std::vector<complex> x = random_samples(n);
+  R r(ratio.in_rate, ratio.out_rate, W);
+  int64_t next = 0;
+  run(options, results, name,
+      params(param("input_rate", ratio.in_rate),
+             param("output_rate", ratio.out_rate), param("W", W)),
+      n, "samples", [&]() {
+        for (size_t i = 0; i < n; i++) {
+          r.push(x[i]);
+          for (next = std::max(next, r.minn()); next <= r.maxn(); next++)
+            r(next);
+        }
+      });
+}
+
+template <typename T>
+static void bench_resamplers(const Options &options,
+                             std::vector<Result> &results,
+                             const std::string &precision) {
+  for (const Ratio &ratio : ratios) {
+    for (double W : widths) {
+      const size_t n = 1 << 16;
+      const std::vector<complex> x = random_samples(n);
+      const std::vector<std::complex<T>> in(x.begin(), x.end());
+      BasicPolyphaseResampler<T> r(ratio.in_rate, ratio.out_rate, W);
+      std::vector<std::complex<T>> out;
+      run(options, results, "polyphase_resampler_" + precision,
+          params(param("input_rate", ratio.in_rate),
+                 param("output_rate", ratio.out_rate), param("W", W)),
+          n, "samples", [&]() {
+            out.resize(r.max_output(n));
+            r.process(in.data(), n, out.data());
+          });
+    }
+  }
+}
+
+static void bench_resampling(const Options &options,
+                             std::vector<Result> &results) {
+  for (const Ratio &ratio : ratios) {
+    for (double W : widths) {
+      if (ratio.in_rate <= ratio.out_rate)
+        bench_per_sample<Upsampler>(options, results, "upsampler", ratio, W);
+      else
+        bench_per_sample<Downsampler>(options, results, "downsampler", ratio,
+                                      W);
+    }
+  }
+  bench_resamplers<double>(options, results, "double");
+  bench_resamplers<float>(options, results, "float");
+}
+
+static void bench_fft(const Options &options, std::vector<Result> &results) {
+  const unsigned int sizes[] = {64, 256, 1000, 1024, 3000, 4096, 65536};
+  for (unsigned int N : sizes) {
+    std::vector<complex> x = random_samples(N);
+    std::vector<myriota_complex> y(N);
+    const myriota_complex *in = reinterpret_cast<myriota_complex *>(x.data());
+    run(options, results, "fft", param("N", N), N, "samples",
+        [&]() { myriota_fft(N, in, y.data()); });
+    myriota_fft_plan *plan = myriota_fft_plan_create(N);
+    run(options, results, "fft_plan", param("N", N), N, "samples",
+        [&]() { myriota_fft_execute(plan, in, y.data()); });
+    myriota_fft_plan_destroy(plan);
+  }
+}
+
+static void bench_crc32(const Options &options, std::vector<Result> &results) {
+  const size_t lengths[] = {16, 256, 4096, 65536, 1 << 20};
+  for (size_t n : lengths) {
+    const std::vector<uint8_t> b = random_bytes(n);
+    uint32_t crc = 0;
+    run(options, results, "crc32", param("length", n), n, "bytes",
+        [&]() { crc = myriota_crc32(b.data(), n, crc); });
+  }
+}
+
+static void bench_codecs(const Options &options,
+                         std::vector<Result> &results) {
+  const size_t lengths[] = {15, 255, 4095};
+  for (size_t n : lengths) {
+    const std::vector<uint8_t> b = random_bytes(n);
+    std::vector<char> s(2 * n + 1);
+    std::vector<uint8_t> d(n + 8);
+    run(options, results, "hex_encode", param("bytes", n), n, "bytes",
+        [&]() { myriota_buf_to_hex(b.data(), n, s.data()); });
+    run(options, results, "hex_decode", param("bytes", n), n, "bytes",
+        [&]() { myriota_n_hex_to_buf(s.data(), 2 * n, d.data()); });
+    run(options, results, "base64_encode", param("bytes", n), n, "bytes",
+        [&]() { myriota_buf_to_base64(b.data(), n, s.data()); });
+    const size_t n64 = n * 4 / 3;
+    run(options, results, "base64_decode", param("bytes", n), n, "bytes",
+        [&]() { myriota_n_base64_to_buf(s.data(), n64, d.data()); });
+    run(options, results, "zbase32_encode", param("bytes", n), n, "bytes",
+        [&]() { myriota_buf_to_zbase32(b.data(), n, s.data()); });
+    const size_t n32 = n * 8 / 5;
+    run(options, results, "zbase32_decode", param("bytes", n), n, "bytes",
+        [&]() { myriota_n_zbase32_to_buf(s.data(), n32, d.data()); });
+  }
+}
+
+// Tracker example messages, a packed little endian struct of a 16 bit
+// sequence number, latitude, longitude and timestamp padded to 20 bytes
+static void bench_bit_fields(const Options &options,
+                             std::vector<Result> &results) {
+  const size_t message_size = 20;
+  const size_t counts[] = {1, 1000, 100000};
+  for (size_t n : counts) {
+    const std::vector<uint8_t> messages = random_bytes(n * message_size);
+    std::vector<uint16_t> sequence_number(n);
+    std::vector<int32_t> latitude(n), longitude(n);
+    std::vector<uint32_t> time(n);
+    const myriota_bit_field fields[] = {
+        {0, 16, false, true, sequence_number.data(), 2},
+        {16, 32, true, true, latitude.data(), 4},
+        {48, 32, true, true, longitude.data(), 4},
+        {80, 32, false, true, time.data(), 4}};
+    run(options, results, "unpack_bit_fields", param("messages", n), n,
+        "messages", [&]() {
+          myriota_unpack_bit_fields(messages.data(), message_size, n, fields,
+                                    4);
+        });
+  }
+  const size_t bits = 1 << 16;
+  const std::vector<uint8_t> from = random_bytes(bits / 8 + 1);
+  std::vector<uint8_t> to(bits / 8 + 2);
+  run(options, results, "write_bits", param("bits", bits), bits, "bits",
+      [&]() { myriota_write_bits(from.data(), to.data(), 3, bits + 2); });
+  run(options, results, "read_bits", param("bits", bits), bits, "bits",
+      [&]() { myriota_read_bits(from.data(), to.data(), 5, bits + 4); });
+}
+
+static void bench_matrix(const Options &options,
+                         std::vector<Result> &results) {
+  const int sizes[] = {4, 16, 64};
+  for (int N : sizes) {
+    std::vector<double> A(N * N), Y(N), X(N);
+    for (int i = 0; i < N * N; i++) A[i] = myriota_random_normal();
+    for (int i = 0; i < N; i++) {
+      A[i * N + i] += N;  // well conditioned
+      Y[i] = myriota_random_normal();
+    }
+    run(options, results, "matrix_solve", param("N", N), 1, "solves",
+        [&]() { myriota_matrix_solve(N, 1, A.data(), Y.data(), X.data()); });
+  }
+  const int gemm_sizes[] = {16, 64, 256};
+  for (int N : gemm_sizes) {
+    std::vector<double> A(N * N), B(N * N), X(N * N);
+    for (int i = 0; i < N * N; i++) {
+      A[i] = myriota_random_normal();
+      B[i] = myriota_random_normal();
+    }
+    run(options, results, "matrix_multiply", param("N", N), 2.0 * N * N * N,
+        "flops", [&]() {
+          myriota_matrix_multiply(N, N, N, A.data(), B.data(), X.data());
+        });
+    run(options, results, "matrix_transpose", param("N", N), N * N, "elements",
+        [&]() { myriota_matrix_transpose(N, N, A.data(), X.data()); });
+  }
+  const int samples = 100000;
+  std::vector<double> t(samples), x(samples);
+  for (int n = 0; n < samples; n++) {
+    t[n] = 1.5e9 + n;  // epoch timestamps
+    x[n] = 1e-3 * n + myriota_random_normal();
+  }
+  double a[4];
+  run(options, results, "polyfit", params(param("N", samples), param("r", 3)),
+      samples, "samples",
+      [&]() { myriota_polyfit(t.data(), x.data(), samples, 3, a); });
+}
+
+static void bench_median(const Options &options,
+                         std::vector<Result> &results) {
+  const size_t sizes[] = {101, 10000, 1000000};
+  for (size_t n : sizes) {
+    std::vector<double> x(n), work(n);
+    for (size_t i = 0; i < n; i++) x[i] = myriota_random_normal();
+    run(options, results, "median_double", param("N", n), n, "elements",
+        [&]() {
+          std::copy(x.begin(), x.end(), work.begin());
+          myriota_median_double(work.data(), n);
+        });
+  }
+  const unsigned int windows[] = {15, 255, 4095};
+  for (unsigned int w : windows) {
+    const size_t n = 1 << 16;
+    std::vector<double> x(n);
+    for (size_t i = 0; i < n; i++) x[i] = myriota_random_normal();
+    myriota_running_median *m = myriota_running_median_create(w);
+    run(options, results, "running_median", param("window", w), n, "samples",
+        [&]() {
+          for (size_t i = 0; i < n; i++) myriota_running_median_push(m, x[i]);
+        });
+    myriota_running_median_destroy(m);
+  }
+}
+
+static int compare_uint64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Identifiers with about 10% duplicates
+static void bench_sort_unique(const Options &options,
+                              std::vector<Result> &results) {
+  const size_t sizes[] = {1000, 1000000};
+  for (size_t n : sizes) {
+    std::vector<uint64_t> x(n), work(n), scratch(n);
+    for (size_t i = 0; i < n; i++)
+      x[i] = (uint64_t)rand() * rand() % (uint64_t)(0.9 * n) + (1ull << 40);
+    run(options, results, "sort_unique", param("N", n), n, "elements", [&]() {
+      std::copy(x.begin(), x.end(), work.begin());
+      myriota_sort_unique(work.data(), n, sizeof(uint64_t), compare_uint64);
+    });
+    run(options, results, "sort_unique_uint64", param("N", n), n, "elements",
+        [&]() {
+          std::copy(x.begin(), x.end(), work.begin());
+          myriota_sort_unique_uint64(work.data(), n, scratch.data());
+        });
+  }
+}
+
+// Elements are a length byte followed by that many bytes, terminated by zero
+static unsigned int tlv_size(const void *e) {
+  if (e == NULL) return 0;
+  const uint8_t *b = (const uint8_t *)e;
+  return b[0] ? 1 + b[0] : 0;
+}
+
+static int tlv_end(void *e) {
+  if (e != NULL) *(uint8_t *)e = 0;
+  return 1;
+}
+
+static void bench_tlv(const Options &options, std::vector<Result> &results) {
+  const unsigned int sizes[] = {100, 10000};
+  for (unsigned int n : sizes) {
+    std::vector<uint8_t> element = random_bytes(9), buffer(10 * n + 1);
+    element[0] = 8;
+    run(options, results, "tlv_append", param("N", n), n, "elements", [&]() {
+      tlv_end(buffer.data());
+      for (unsigned int i = 0; i < n; i++)
+        myriota_tlv_append(buffer.data(), element.data(), tlv_size, tlv_end);
+    });
+    run(options, results, "tlv_index_append", param("N", n), n, "elements",
+        [&]() {
+          myriota_tlv_index x;
+          tlv_end(buffer.data());
+          myriota_tlv_index_init(&x, buffer.data(), tlv_size, tlv_end);
+          for (unsigned int i = 0; i < n; i++)
+            myriota_tlv_index_append(&x, element.data());
+          myriota_tlv_index_free(&x);
+        });
+  }
+}
+
+static void bench_sinusoid(const Options &options,
+                           std::vector<Result> &results) {
+  const unsigned int sizes[] = {256, 1000, 4096};
+  for (unsigned int N : sizes) {
+    const unsigned int M = myriota_greater_power_of_two(N);
+    std::vector<myriota_complex> x(M, 0), work(M);
+    for (unsigned int n = 0; n < N; n++)
+      x[n] = myriota_polar(1, 2 * pi * 0.1234 * n) +
+             0.1 * myriota_rectangular(myriota_random_normal(),
+                                       myriota_random_normal());
+    run(options, results, "detect_sinusoid", param("N", N), N, "samples",
+        [&]() {
+          myriota_decimal f, rv, c;
+          myriota_complex a;
+          std::copy(x.begin(), x.end(), work.begin());
+          myriota_detect_sinusoid_inplace(work.data(), N, &f, &a, &rv, &c);
+        });
+  }
+}
+
+static void print_json(const std::vector<Result> &results,
+                       const Options &options) {
+  printf("{\n");
+  printf("  \"sdk_version\": \"%s\",\n", MYRIOTA_SDK_VERSION);
+  printf("  \"min_time\": %g,\n", options.min_time);
+  printf("  \"repetitions\": %u,\n", options.repetitions);
+  printf("  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    printf(
+        "    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %llu, "
+        "\"median_seconds\": %.6e, \"best_seconds\": %.6e, "
+        "\"%s_per_second\": %.6e}%s\n",
+        r.name.c_str(), r.params.c_str(), (unsigned long long)r.iterations,
+        r.median, r.best, r.unit.c_str(), r.items / r.best,
+        i + 1 < results.size() ? "," : "");
+  }
+  printf("  ]\n");
+  printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  cmdline::parser cmd_parser;
+  cmd_parser.add<double>("min-time", 't',
+                         "minimum seconds per measurement", false, 0.2);
+  cmd_parser.add<unsigned int>("repetitions", 'n',
+                               "measurements per benchmark", false, 5,
+                               cmdline::range<unsigned int>(1, 1000));
+  cmd_parser.add<std::string>(
+      "filter", 'f', "only run benchmarks whose name contains this string",
+      false, "");
+  cmd_parser.set_description(
+      "Runs myriotamath microbenchmarks and writes the results to stdout as\n"
+      "JSON. Progress is printed to stderr.\n");
+  cmd_parser.parse_check(argc, argv);
+
+  Options options = {cmd_parser.get<double>("min-time"),
+                     cmd_parser.get<unsigned int>("repetitions"),
+                     cmd_parser.get<std::string>("filter")};
+
+  srand(1);
+  std::vector<Result> results;
+  bench_resampling(options, results);
+  bench_fft(options, results);
+  bench_crc32(options, results);
+  bench_codecs(options, results);
+  bench_bit_fields(options, results);
+  bench_matrix(options, results);
+  bench_median(options, results);
+  bench_sort_unique(options, results);
+  bench_tlv(options, results);
+  bench_sinusoid(options, results);
+  print_json(results, options);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "math/myriotamath.h"
+#include "tools/cmdline.h"
+#include "tools/convert_type.h"
+
+// Equivalent to
+//   convert_type -f uint8 | resampler -i in_rate -r out_rate | convert_type -t
+//   int16
+// in a single process. Output is written in chunks of chunk_size samples, with
+// the output stream flushed at every chunk boundary.
+
+// write n int16 complex samples to stdout
+static void write_chunk(const int16_t *samples, size_t n) {
+  if (fwrite(samples, 2 * sizeof(int16_t), n, stdout) == n &&
+      fflush(stdout) == 0)
+    return;
+  fprintf(stderr, "capture_pipeline failed to write samples\n");
+  exit(EXIT_FAILURE);
+}
+
+// replace each int16 component of samples after the first by its difference
+// from the previous sample, modulo 2^16, so the chunk decodes on its own
+static void delta_code(int16_t *samples, size_t n) {
+  for (size_t i = 2 * n; i-- > 2;)
+    samples[i] = (int16_t)((uint16_t)samples[i] - (uint16_t)samples[i - 2]);
+}
+
+template <typename T>
+static void capture(FILE *infile, myriota::BasicPolyphaseResampler<T> &r,
+                    size_t block_size, size_t chunk_size, bool delta) {
+  std::vector<uint8_t> raw(2 * block_size);
+  std::vector<std::complex<T>> in(block_size);
+  std::vector<std::complex<T>> out(r.max_output(block_size));
+  std::vector<int16_t> chunk(2 * chunk_size);
+  size_t fill = 0;  // samples in current chunk
+  size_t n_in;
+  while ((n_in = fread(raw.data(), 2 * sizeof(uint8_t), block_size, infile)) >
+         0) {
+    convert_samples_from_type<uint8_t>(raw.data(), n_in, in.data());
+    out.resize(r.max_output(n_in));
+    const size_t n_out = r.process(in.data(), n_in, out.data());
+    for (size_t i = 0; i < n_out;) {
+      const size_t n = std::min(n_out - i, chunk_size - fill);
+      bool clipped;
+      convert_samples_to_type<int16_t>(&out[i], n, &chunk[2 * fill], false,
+                                       clipped);
+      fill += n;
+      i += n;
+      if (fill == chunk_size) {
+        if (delta) delta_code(chunk.data(), fill);
+        write_chunk(chunk.data(), fill);
+        fill = 0;
+      }
+    }
+  }
+  if (fill > 0) {
+    if (delta) delta_code(chunk.data(), fill);
+    write_chunk(chunk.data(), fill);
+  }
+}
+
+int main(int argc, char **argv) {
+  cmdline::parser cmd_parser;
+
+  cmd_parser.add<double>("input_rate", 'i', "input sample rate", true);
+  cmd_parser.add<double>("output_rate", 'r', "output sample rate", true);
+  cmd_parser.add<double>("window_width", 'W',
+                         "larger is slower, but more accurate", false, 30);
+  cmd_parser.add<size_t>("block-size", 'b',
+                         "number of input samples read at a time", false,
+                         65536, cmdline::range<size_t>(1, 1 << 24));
+  cmd_parser.add<size_t>("chunk-size", 'c',
+                         "number of output samples written at a time", false,
+                         65536, cmdline::range<size_t>(1, 1 << 28));
+  cmd_parser.add<std::string>("precision", 'p',
+                              "precision of the resampling arithmetic", false,
+                              "double",
+                              cmdline::oneof<std::string>("double", "float"));
+  cmd_parser.add("delta", 'd',
+                 "delta code the int16 components within each chunk");
+  cmd_parser.set_description(
+      "Converts uint8 complex samples to int16 complex samples while "
+      "resampling\nfrom input rate to output rate. Input samples via stdin, "
+      "output samples\nare written to stdout in chunks of chunk-size "
+      "samples.\n");
+
+  cmd_parser.parse_check(argc, argv);
+
+  const double in_rate = cmd_parser.get<double>("input_rate");
+  const double out_rate = cmd_parser.get<double>("output_rate");
+  const double W = cmd_parser.get<double>("window_width");
+  const size_t block_size = cmd_parser.get<size_t>("block-size");
+  const size_t chunk_size = cmd_parser.get<size_t>("chunk-size");
+  const std::string precision = cmd_parser.get<std::string>("precision");
+  const bool delta = cmd_parser.exist("delta");
+
+  if (precision == "float") {
+    myriota::BasicPolyphaseResampler<float> r(in_rate, out_rate, W);
+    capture(stdin, r, block_size, chunk_size, delta);
+  } else {
+    myriota::BasicPolyphaseResampler<double> r(in_rate, out_rate, W);
+    capture(stdin, r, block_size, chunk_size, delta);
+  }
+
+  return EXIT_SUCCESS;
+}
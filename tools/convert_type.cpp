@@ -16,6 +16,42 @@
 #include <stdlib.h>
 #include "tools/cmdline.h"
 
+typedef int (*converter)(FILE *, FILE *, size_t, bool);
+
+// Convert samples of type TIn from infile to type TOut on outfile, one block
+// at a time. Samples are converted directly, without widening to complex
+// double, so e.g. uint8 to float conversion only touches 10 bytes per sample.
+template <typename TIn, typename TOut>
+int convert(FILE *infile, FILE *outfile, size_t block_size, bool exit_on_clip) {
+  std::vector<TIn> in(2 * block_size);
+  std::vector<TOut> out(2 * block_size);
+  size_t n;
+  while ((n = fread(in.data(), 2 * sizeof(TIn), block_size, infile)) > 0) {
+    bool clipped;
+    const size_t count = convert_samples_between_types<TIn, TOut>(
+        in.data(), n, out.data(), exit_on_clip, clipped);
+    if (fwrite(out.data(), 2 * sizeof(TOut), count, outfile) < count) {
+      std::cerr << "convert_type failed to write samples" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (exit_on_clip && clipped) return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// converter from TIn to the named output type, NULL if the type is unknown
+template <typename TIn>
+converter output_converter(const std::string &type) {
+  if (type == "double") return convert<TIn, double>;
+  if (type == "float") return convert<TIn, float>;
+  if (type == "uint8") return convert<TIn, uint8_t>;
+  if (type == "int8") return convert<TIn, int8_t>;
+  if (type == "int16") return convert<TIn, int16_t>;
+  if (type == "uint16") return convert<TIn, uint16_t>;
+  if (type == "int32") return convert<TIn, int32_t>;
+  return NULL;
+}
+
 int main(int argc, char **argv) {
   cmdline::parser cmd_parser;
 
@@ -34,29 +70,33 @@ int main(int argc, char **argv) {
   cmd_parser.add("exit-on-clip", 'e',
                  "program will exit with EXIT_FAILURE return code if any "
                  "clipping detected");
+  cmd_parser.add<size_t>("block-size", 'b',
+                         "number of samples read and written at a time", false,
+                         65536, cmdline::range<size_t>(1, 1 << 24));
   cmd_parser.parse_check(argc, argv);
 
   // Get input/output type and check if conversion necessary
   const std::string input_type = cmd_parser.get<std::string>("from");
   const std::string output_type = cmd_parser.get<std::string>("to");
   const bool exit_on_clip = cmd_parser.exist("exit-on-clip");
+  const size_t block_size = cmd_parser.get<size_t>("block-size");
 
-  // assign function to read samples from file
-  bool (*read_sample)(FILE * stdin, complex & sample);
+  // assign function to convert from input type to output type
+  converter convert_samples;
   if (input_type == "double")
-    read_sample = read_sample_of_type<double>;
+    convert_samples = output_converter<double>(output_type);
   else if (input_type == "float")
-    read_sample = read_sample_of_type<float>;
+    convert_samples = output_converter<float>(output_type);
   else if (input_type == "uint8")
-    read_sample = read_sample_of_type<uint8_t>;
+    convert_samples = output_converter<uint8_t>(output_type);
   else if (input_type == "int8")
-    read_sample = read_sample_of_type<int8_t>;
+    convert_samples = output_converter<int8_t>(output_type);
   else if (input_type == "int16")
-    read_sample = read_sample_of_type<int16_t>;
+    convert_samples = output_converter<int16_t>(output_type);
   else if (input_type == "uint16")
-    read_sample = read_sample_of_type<uint16_t>;
+    convert_samples = output_converter<uint16_t>(output_type);
   else if (input_type == "int32")
-    read_sample = read_sample_of_type<int32_t>;
+    convert_samples = output_converter<int32_t>(output_type);
   else {
     std::cerr << "Input type must be one of double, float, uint8, int8, int16, "
                  "uint16, or int32"
@@ -64,24 +104,7 @@ int main(int argc, char **argv) {
     std::cerr << cmd_parser.usage();
     return EXIT_FAILURE;
   }
-
-  // assign function to write sample to stdout
-  bool (*print_sample)(FILE *, const complex);
-  if (output_type == "double")
-    print_sample = print_sample_of_type<double>;
-  else if (output_type == "float")
-    print_sample = print_sample_of_type<float>;
-  else if (output_type == "uint8")
-    print_sample = print_sample_of_type<uint8_t>;
-  else if (output_type == "int8")
-    print_sample = print_sample_of_type<int8_t>;
-  else if (output_type == "int16")
-    print_sample = print_sample_of_type<int16_t>;
-  else if (output_type == "uint16")
-    print_sample = print_sample_of_type<uint16_t>;
-  else if (output_type == "int32")
-    print_sample = print_sample_of_type<int32_t>;
-  else {
+  if (convert_samples == NULL) {
     std::cerr
         << "Output type must be one of double, float, int8, int16, uint16, or "
            "int32"
@@ -91,11 +114,5 @@ int main(int argc, char **argv) {
   }
 
   // the actual conversion loop
-  complex sample;
-  while (read_sample(stdin, sample)) {
-    const bool clipped = print_sample(stdout, sample);
-    if (exit_on_clip && clipped) return EXIT_FAILURE;
-  }
-
-  return EXIT_SUCCESS;
+  return convert_samples(stdin, stdout, block_size, exit_on_clip);
 }
@@ -18,6 +18,7 @@
 #include <complex>
 #include <limits>
 #include <string>
+#include <vector>
 
 typedef std::complex<double> complex;
 
@@ -30,22 +31,31 @@ const double offset() {
   return ceil((highest - lowest) / 2.0);
 }
 
-// read complex samples of templated type from input file
-template <typename T>
-bool read_sample_of_type(FILE *infile, complex &sample) {
+// convert n complex samples of templated type to complex samples of
+// precision S, e.g. double or float
+template <typename T, typename S>
+void convert_samples_from_type(const T *in, size_t n,
+                               std::complex<S> *samples) {
   const double off = offset<T>();
-  T buf[2];
-  if (fread(buf, sizeof(T), 2, infile) < 2) return false;
-  sample = complex(buf[0] - off, buf[1] - off);
-  return true;
+  for (size_t i = 0; i < n; i++)
+    samples[i] = std::complex<S>(in[2 * i] - off, in[2 * i + 1] - off);
+}
+
+// read up to n complex samples of templated type from input file, returns
+// the number of complete samples read
+template <typename T>
+size_t read_samples_of_type(FILE *infile, complex *samples, size_t n) {
+  std::vector<T> buf(2 * n);
+  const size_t count = fread(buf.data(), sizeof(T), 2 * n, infile) / 2;
+  convert_samples_from_type<T>(buf.data(), count, samples);
+  return count;
 }
 
-// saturation
+// saturation, sets clipped if x is outside the range of the templated type
 template <typename T>
 double limit(double x, bool &clipped) {
   const double lowest = std::numeric_limits<T>::lowest();
   const double highest = std::numeric_limits<T>::max();
-  clipped = false;
   if (x > highest) {
     x = highest;
     clipped = true;
@@ -57,16 +67,55 @@ double limit(double x, bool &clipped) {
   return x;
 }
 
-// cast complex sample to templated type and print sample to stdout
-template <typename T>
-bool print_sample_of_type(FILE *file, const complex sample) {
+// cast n complex samples to templated type. If stop_on_clip is set only
+// samples up to and including the first clipped sample are converted. Returns
+// the number of samples converted and sets clipped if any of them was clipped.
+template <typename T, typename S>
+size_t convert_samples_to_type(const std::complex<S> *samples, size_t n,
+                               T *out, bool stop_on_clip, bool &clipped) {
   const double off = offset<T>();
-  bool clipped;
-  const T sample_2[2] = {
-      static_cast<T>(limit<T>(std::real(sample) + off, clipped)),
-      static_cast<T>(limit<T>(std::imag(sample) + off, clipped))};
-  fwrite(sample_2, sizeof(T), 2, file);
-  return clipped;
+  size_t count = 0;
+  clipped = false;
+  while (count < n && !(stop_on_clip && clipped)) {
+    const double re = std::real(samples[count]);
+    const double im = std::imag(samples[count]);
+    out[2 * count] = static_cast<T>(limit<T>(re + off, clipped));
+    out[2 * count + 1] = static_cast<T>(limit<T>(im + off, clipped));
+    count++;
+  }
+  return count;
+}
+
+// convert n complex samples of type TIn directly to type TOut, without an
+// intermediate complex buffer. Equivalent to convert_samples_from_type
+// followed by convert_samples_to_type.
+template <typename TIn, typename TOut>
+size_t convert_samples_between_types(const TIn *in, size_t n, TOut *out,
+                                     bool stop_on_clip, bool &clipped) {
+  const double off = offset<TOut>() - offset<TIn>();
+  size_t count = 0;
+  clipped = false;
+  while (count < n && !(stop_on_clip && clipped)) {
+    out[2 * count] =
+        static_cast<TOut>(limit<TOut>(in[2 * count] + off, clipped));
+    out[2 * count + 1] =
+        static_cast<TOut>(limit<TOut>(in[2 * count + 1] + off, clipped));
+    count++;
+  }
+  return count;
+}
+
+// cast n complex samples to templated type and write them to file. If
+// stop_on_clip is set only samples up to and including the first clipped
+// sample are written. Returns the number of samples written and sets clipped
+// if any written sample was clipped.
+template <typename T>
+size_t print_samples_of_type(FILE *file, const complex *samples, size_t n,
+                             bool stop_on_clip, bool &clipped) {
+  std::vector<T> buf(2 * n);
+  const size_t count =
+      convert_samples_to_type<T>(samples, n, buf.data(), stop_on_clip, clipped);
+  return fwrite(buf.data(), sizeof(T), 2 * count, file) / 2;
 }
 
 #endif
@@ -16,51 +16,73 @@
 
 from __future__ import print_function
 import sys
+import os.path
+import re
 import struct
+import subprocess
 import time
 import serial
 import argparse
 import binascii
+from distutils.spawn import find_executable
 
-errors = {0:  'Internal test',
-          1:  'Factory reset',
-          2:  'Watchdog reset',
-          3:  'System states',
-          4:  'MCU faults',
-          5:  'Invalid key',
-          6:  'Application starts',
-          7:  'Assertion failure',
-          8:  'Memory error',
-          9:  'Stack low in space',
-          10: 'Stack overflow'}
-
-unpack_strings = {
-    'Internal test':'<II',
-    'Watchdog reset': '<II',
-    'System states': '<IIIIIIIIIIII',
-    'MCU faults': '<IIII',
-    'Application starts': '<QI',
-    'Assertion failure': '<II',
-    'Stack low in space': '<II',
-    'Stack overflow': '<I'
-}
-
-contents = {
-    'Internal test': ['Test1', 'Test2'],
-    'Watchdog reset': ['LastJobId', 'Timeout counter'],
-    'System states':
-        ['Number of transmissions', 'Wakeup times',
-         'Last GNSS fix time', 'Last job ID',
-         'Watchdog timeouted job ID', 'Watchdog timeout counter',
-         'Last transmission time', 'Last log ID',
-         'GNSS fix failures', 'GNSS fix successes',
-         'GNSS total fix time', 'Number of user messages'],
-    'MCU faults':  ['CFSR', 'LR', 'PC', 'PSR'],
-    'Application starts': ['Build hash', 'SDK version'],
-    'Assertion failure': ['Return address', 'Line number'],
-    'Stack low in space': ['JobId', 'StackUsage'],
-    'Stack overflow': ['JobId']
-}
+
+# directory of the SDK tools, through any symlink to this script
+TOOLS_DIR = os.path.dirname(os.path.realpath(__file__))
+
+
+def load_log_codes(path=os.path.join(TOOLS_DIR, 'log_codes.h')):
+    '''
+    Read the code table shared with log_decoder from log_codes.h. Codes are
+    numbers, or a number defined in the file plus an offset. Returns the names
+    by code, and the struct layouts and field names by name.
+    '''
+    errors, unpack_strings, contents, defines = {}, {}, {}, {}
+    try:
+        f = open(path)
+    except IOError:
+        raise IOError('%s not found, it is read from the tools directory of '
+                      'the SDK next to log-util.py' % os.path.basename(path))
+    with f:
+        for line in f:
+            define = re.match(r'\s*#define\s+(\w+)\s+(\d+)\s*$', line)
+            if define is not None:
+                defines[define.group(1)] = int(define.group(2))
+                continue
+            entry = re.match(
+                r'\s*LOG_CODE\(\s*(\w+)\s*(?:\+\s*(\d+)\s*)?,(.*)\)\s*$', line)
+            if entry is None:
+                continue
+            base = entry.group(1)
+            code = int(base) if base.isdigit() else defines[base]
+            code += int(entry.group(2) or 0)
+            strings = re.findall(r'"([^"]*)"', entry.group(3))
+            errors[code] = strings[0]
+            unpack_strings[strings[0]] = strings[1]
+            contents[strings[0]] = strings[2:]
+    return errors, unpack_strings, contents
+
+
+# code table of decode_log, read by load_code_tables when decoding
+errors, unpack_strings, contents = {}, {}, {}
+
+
+def load_code_tables(profile=False):
+    '''
+    Read the code table from log_codes.h and, with profile, add the user error
+    codes written by terminal/profile, from profile_log_codes.h.
+    '''
+    for table, codes in zip((errors, unpack_strings, contents),
+                            load_log_codes()):
+        table.update(codes)
+    if not profile:
+        return
+    path = os.path.join(TOOLS_DIR, 'profile_log_codes.h')
+    user_errors, user_unpack_strings, user_contents = load_log_codes(path)
+    for code, name in user_errors.items():
+        errors[code + 0x80] = name
+    unpack_strings.update(user_unpack_strings)
+    contents.update(user_contents)
 
 
 def dump_bytes(bytes):
@@ -102,7 +124,7 @@ def decode_log(logfile):
             # UTC time
             time_string = time.strftime('%Y-%m-%d %H:%M:%S UTC',
                                         time.gmtime(float(timestamp)))
-            if code >= 0x80:
+            if code >= 0x80 and code not in errors:
                 print ('====%s User error code %d===='
                        % (time_string, (code-0x80)))
                 if length != 0:
@@ -146,6 +168,27 @@ def decode_log(logfile):
                                 dump_bytes(bytes)
 
 
+def decode_log_native(logfile, format, profile=False):
+    '''
+    Decode with the log_decoder tool, found next to this script or on the
+    PATH, writing CSV or JSON to stdout. Returns True if there is no log, as
+    decode_log does.
+    '''
+    decoder = os.path.join(TOOLS_DIR, 'log_decoder')
+    if not os.path.isfile(decoder):
+        decoder = find_executable('log_decoder')
+    if decoder is None:
+        raise IOError('log_decoder: command not found. Please run make -C tools log_decoder.')
+    sys.stdout.flush()
+    options = ['-p'] if profile else []
+    status = subprocess.call([decoder, '-f', format] + options + [logfile])
+    if status == 2:  # read, but holds no log
+        return True
+    if status != 0:
+        raise IOError('log_decoder failed')
+    return False
+
+
 def capture_bootloader(portname, baudrate, wait_flag):
     if wait_flag:
         print('Waiting for serial port', portname)
@@ -258,8 +301,14 @@ def main():
     parser.add_argument("-x", "--purge", dest="purge_flag",
                         action="store_true",
                         default=False, help="purge the log")
+    parser.add_argument("-f", "--format", dest="format", default='text',
+                        choices=['text', 'csv', 'json'],
+                        help="output format, csv and json use the native log_decoder")
     parser.add_argument("-b", "--baudrate", dest="baud_rate", metavar='BAUDRATE',
                         default=115200, help="set the serial port BAUDRATE")
+    parser.add_argument("--profile", dest="profile_flag", action="store_true",
+                        default=False,
+                        help="decode the user error codes written by terminal/profile")
     args = parser.parse_args()
 
     if args.portname == 'None' and args.infile is None \
@@ -298,8 +347,16 @@ def main():
                 binary_file.write(binascii.unhexlify(dump))
                 binary_file.close()
             infile = outfile
-    print('Decoding', infile)
-    if decode_log(infile):
+    if args.format != 'text':
+        is_empty = decode_log_native(infile, args.format, args.profile_flag)
+    else:
+        try:
+            load_code_tables(args.profile_flag)
+        except IOError as e:
+            sys.exit('Error: %s' % e)
+        print('Decoding', infile)
+        is_empty = decode_log(infile)
+    if is_empty:
         print("No log found")
 
     if ser is not None:
@@ -0,0 +1,31 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Device log codes, shared by log_decoder.cpp and log-util.py. Entries are
+//   LOG_CODE(code, name, layout, field names...)
+// where layout is the Python struct format of the little endian payload, empty
+// if the payload is not decoded. log-util.py parses this file line by line, so
+// keep every entry on a single line. Codes from 128 are LogAdd user error codes
+// plus 128, see profile_log_codes.h.
+
+LOG_CODE(0, "Internal test", "<II", "Test1", "Test2")
+LOG_CODE(1, "Factory reset", "")
+LOG_CODE(2, "Watchdog reset", "<II", "LastJobId", "Timeout counter")
+LOG_CODE(3, "System states", "<IIIIIIIIIIII", "Number of transmissions", "Wakeup times", "Last GNSS fix time", "Last job ID", "Watchdog timeouted job ID", "Watchdog timeout counter", "Last transmission time", "Last log ID", "GNSS fix failures", "GNSS fix successes", "GNSS total fix time", "Number of user messages")
+LOG_CODE(4, "MCU faults", "<IIII", "CFSR", "LR", "PC", "PSR")
+LOG_CODE(5, "Invalid key", "")
+LOG_CODE(6, "Application starts", "<QI", "Build hash", "SDK version")
+LOG_CODE(7, "Assertion failure", "<II", "Return address", "Line number")
+LOG_CODE(8, "Memory error", "")
+LOG_CODE(9, "Stack low in space", "<II", "JobId", "StackUsage")
+LOG_CODE(10, "Stack overflow", "<I", "JobId")
@@ -0,0 +1,399 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tools/cmdline.h"
+
+// Decodes device log images read back by log-util.py. Every entry is
+//   |0-3|4-5|6-7|8-?|
+//   |Timestamp|Length|Code|Payload|
+// in little endian, with the payload padded to a multiple of 4 bytes, and the
+// log ends at a timestamp of 0xFFFFFFFF. Files are mapped into memory and
+// decoded by a pool of threads, with the output written in the order of the
+// files on the command line.
+
+struct LogCode {
+  unsigned int code;
+  const char *name;
+  const char *layout;
+  std::vector<const char *> fields;
+};
+
+#define LOG_CODE(code, name, layout, ...) {code, name, layout, {__VA_ARGS__}},
+static const LogCode log_codes[] = {
+#include "tools/log_codes.h"
+};
+// user error codes, decoded only with --profile
+static const LogCode profile_log_codes[] = {
+#include "tools/profile_log_codes.h"
+};
+#undef LOG_CODE
+
+// exit status when every file was read but some held no log
+static const int NO_LOG_STATUS = 2;
+
+// set by --profile before decoding starts
+static bool decode_profile = false;
+
+static const LogCode *find_code(unsigned int code) {
+  if (code >= 0x80) {
+    if (decode_profile)
+      for (const LogCode &c : profile_log_codes)
+        if (c.code + 0x80 == code) return &c;
+    return NULL;
+  }
+  for (const LogCode &c : log_codes)
+    if (c.code == code) return &c;
+  return NULL;
+}
+
+// Bytes of a struct format character, or 0 if not a supported type
+static size_t type_size(char t) {
+  switch (t) {
+    case 'B':
+      return 1;
+    case 'H':
+      return 2;
+    case 'I':
+      return 4;
+    case 'Q':
+      return 8;
+  }
+  return 0;
+}
+
+// Bytes of the payload described by a struct layout, or 0 if not supported
+static size_t layout_size(const char *layout) {
+  size_t s = 0;
+  for (const char *l = layout; *l; l++) {
+    if (*l == '<') continue;
+    if (type_size(*l) == 0) return 0;
+    s += type_size(*l);
+  }
+  return s;
+}
+
+static uint64_t load_le(const uint8_t *p, size_t n) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+static void append_decimal(std::string &out, uint64_t v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0);
+  while (n > 0) out += digits[--n];
+}
+
+static void append_two_digits(std::string &out, unsigned int v) {
+  out += '0' + v / 10;
+  out += '0' + v % 10;
+}
+
+// Same as strftime "%Y-%m-%d %H:%M:%S UTC" of gmtime, using the civil from
+// days algorithm of Howard Hinnant, as gmtime takes a lock per call
+static void append_time(std::string &out, uint32_t timestamp) {
+  const int64_t z = timestamp / 86400 + 719468;
+  const unsigned int s = timestamp % 86400;
+  const int64_t era = z / 146097;
+  const unsigned int doe = z - era * 146097;
+  const unsigned int yoe =
+      (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned int mp = (5 * doy + 2) / 153;
+  const unsigned int d = doy - (153 * mp + 2) / 5 + 1;
+  const unsigned int m = mp < 10 ? mp + 3 : mp - 9;
+  append_decimal(out, yoe + era * 400 + (m <= 2));
+  out += '-';
+  append_two_digits(out, m);
+  out += '-';
+  append_two_digits(out, d);
+  out += ' ';
+  append_two_digits(out, s / 3600);
+  out += ':';
+  append_two_digits(out, s / 60 % 60);
+  out += ':';
+  append_two_digits(out, s % 60);
+  out += " UTC";
+}
+
+enum Format { CSV, JSON };
+
+// Strings in the output, quoted for the format
+static void append_string(std::string &out, const char *s, Format format) {
+  out += '"';
+  for (; *s; s++) {
+    if (*s == '"')
+      out += format == CSV ? "\"\"" : "\\\"";
+    else if (*s == '\\' && format == JSON)
+      out += "\\\\";
+    else
+      out += *s;
+  }
+  out += '"';
+}
+
+static void append_hex(std::string &out, const uint8_t *p, size_t n) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < n; i++) {
+    out += digits[p[i] >> 4];
+    out += digits[p[i] & 0xf];
+  }
+}
+
+// Values of the payload, "name=value;..." for CSV or an object for JSON
+static void append_fields(std::string &out, const LogCode &c,
+                          const uint8_t *p, Format format) {
+  out += format == CSV ? "\"" : "{";
+  size_t f = 0;
+  for (const char *l = c.layout; *l; l++) {
+    const size_t n = type_size(*l);
+    if (n == 0) continue;
+    const uint64_t value = load_le(p, n);
+    p += n;
+    const char *name = f < c.fields.size() ? c.fields[f] : "";
+    if (format == CSV) {
+      if (f > 0) out += ';';
+      out += name;
+      out += '=';
+    } else {
+      if (f > 0) out += ',';
+      append_string(out, name, JSON);
+      out += ':';
+    }
+    append_decimal(out, value);
+    f++;
+  }
+  out += format == CSV ? "\"" : "}";
+}
+
+static void append_entry(std::string &out, const char *file, uint32_t timestamp,
+                         unsigned int code, const char *name,
+                         const LogCode *decoded, const uint8_t *payload,
+                         size_t n, Format format) {
+  if (format == CSV) {
+    append_string(out, file, CSV);
+    out += ',';
+    append_decimal(out, timestamp);
+    out += ',';
+    append_time(out, timestamp);
+    out += ',';
+    append_decimal(out, code);
+    out += ',';
+    append_string(out, name, CSV);
+    out += ',';
+    if (decoded != NULL) append_fields(out, *decoded, payload, CSV);
+    out += ',';
+    if (decoded == NULL) append_hex(out, payload, n);
+    out += '\n';
+  } else {
+    out += "{\"file\":";
+    append_string(out, file, JSON);
+    out += ",\"timestamp\":";
+    append_decimal(out, timestamp);
+    out += ",\"time\":\"";
+    append_time(out, timestamp);
+    out += "\",\"code\":";
+    append_decimal(out, code);
+    out += ",\"name\":";
+    append_string(out, name, JSON);
+    if (decoded != NULL) {
+      out += ",\"fields\":";
+      append_fields(out, *decoded, payload, JSON);
+    } else {
+      out += ",\"payload\":\"";
+      append_hex(out, payload, n);
+      out += '"';
+    }
+    out += "}\n";
+  }
+}
+
+// Decode the log image in [p, p + size) into out. Mirrors decode_log in
+// log-util.py. Returns the number of entries.
+static size_t decode(const char *file, const uint8_t *p, size_t size,
+                     Format format, std::string &out, std::string &errors) {
+  size_t offset = 0, entries = 0;
+  while (true) {
+    if (size - offset < 8) {
+      if (size != offset)
+        errors += std::string(file) + ": incomplete log entry\n";
+      break;
+    }
+    const uint32_t timestamp = load_le(p + offset, 4);
+    const size_t length = load_le(p + offset + 4, 2);
+    const unsigned int code = load_le(p + offset + 6, 2);
+    offset += 8;
+    if (timestamp == 0xFFFFFFFF) break;  // end of the log
+    const size_t n = std::min((length + 3) / 4 * 4, size - offset);
+    const uint8_t *payload = p + offset;
+    offset += n;
+    entries++;
+    if (n < length) {
+      append_entry(out, file, timestamp, code, "Incomplete log payload", NULL,
+                   payload, n, format);
+      break;
+    }
+    const LogCode *c = find_code(code);
+    // like struct.unpack, the padded payload must match the layout exactly
+    const bool decoded = c != NULL && n > 0 && layout_size(c->layout) == n;
+    std::string name;
+    if (c == NULL && code >= 0x80)
+      name = "User error code " + std::to_string(code - 0x80);
+    else if (c == NULL)
+      name = "Unknown error code " + std::to_string(code);
+    else if (n > 0 && !decoded)
+      name = std::string(c->name) + " (unable to decode)";
+    append_entry(out, file, timestamp, code,
+                 name.empty() ? c->name : name.c_str(), decoded ? c : NULL,
+                 payload, n, format);
+  }
+  return entries;
+}
+
+struct Result {
+  std::string out;
+  std::string errors;
+  bool failed = false;  // unreadable
+  bool empty = false;   // no log found
+  bool done = false;
+};
+
+static void decode_file(const char *file, Format format, Result &r) {
+  const int fd = open(file, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    r.errors = std::string(file) + ": " + strerror(errno) + "\n";
+    r.failed = true;
+    if (fd >= 0) close(fd);
+    return;
+  }
+  const size_t size = st.st_size;
+  void *p = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  close(fd);
+  if (p == MAP_FAILED) {
+    r.errors = std::string(file) + ": " + strerror(errno) + "\n";
+    r.failed = true;
+    return;
+  }
+  if (size > 0) madvise(p, size, MADV_SEQUENTIAL);
+  if (decode(file, (const uint8_t *)p, size, format, r.out, r.errors) == 0) {
+    r.errors += std::string(file) + ": no log found\n";
+    r.empty = true;
+  }
+  if (size > 0) munmap(p, size);
+}
+
+int main(int argc, char **argv) {
+  cmdline::parser cmd_parser;
+
+  cmd_parser.add<std::string>("format", 'f', "output format", false, "csv",
+                              cmdline::oneof<std::string>("csv", "json"));
+  cmd_parser.add<unsigned int>("threads", 'j', "number of decoding threads",
+                               false, std::thread::hardware_concurrency(),
+                               cmdline::range<unsigned int>(1, 1024));
+  cmd_parser.add("no-header", 'n', "omit the CSV header line");
+  cmd_parser.add("profile", 'p',
+                 "decode the user error codes written by terminal/profile");
+  cmd_parser.footer("log_file ...");
+  cmd_parser.set_description(
+      "Decodes Myriota device log images read back by log-util.py. Entries "
+      "are\nwritten to stdout as CSV, or as one JSON object per line. Exits "
+      "with\nfailure if any file cannot be read, or else with status 2 if any "
+      "file\nholds no log.\n");
+
+  cmd_parser.parse_check(argc, argv);
+  decode_profile = cmd_parser.exist("profile");
+
+  const Format format = cmd_parser.get<std::string>("format") == "json"
+                            ? JSON
+                            : CSV;
+  const std::vector<std::string> &files = cmd_parser.rest();
+  if (files.empty()) {
+    fprintf(stderr, "%s", cmd_parser.usage().c_str());
+    return EXIT_FAILURE;
+  }
+  const unsigned int threads = std::max<size_t>(
+      1, std::min<size_t>(cmd_parser.get<unsigned int>("threads"),
+                          files.size()));
+
+  std::vector<Result> results(files.size());
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::vector<std::thread> workers;
+  for (unsigned int w = 0; w < threads; w++)
+    workers.push_back(std::thread([&]() {
+      size_t i;
+      while ((i = next++) < files.size()) {
+        Result r;
+        decode_file(files[i].c_str(), format, r);
+        std::lock_guard<std::mutex> lock(mutex);
+        results[i].out.swap(r.out);
+        results[i].errors.swap(r.errors);
+        results[i].failed = r.failed;
+        results[i].empty = r.empty;
+        results[i].done = true;
+        ready.notify_one();
+      }
+    }));
+
+  if (format == CSV && !cmd_parser.exist("no-header"))
+    printf("file,timestamp,time,code,name,fields,payload\n");
+  int status = EXIT_SUCCESS;
+  bool empty = false;
+  for (size_t i = 0; i < files.size(); i++) {
+    Result r;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [&]() { return results[i].done; });
+      r.out.swap(results[i].out);
+      r.errors.swap(results[i].errors);
+      r.failed = results[i].failed;
+      r.empty = results[i].empty;
+    }
+    if (!r.out.empty() &&
+        fwrite(r.out.data(), 1, r.out.size(), stdout) != r.out.size()) {
+      fprintf(stderr, "log_decoder failed to write output\n");
+      status = EXIT_FAILURE;
+      break;
+    }
+    if (!r.errors.empty()) fputs(r.errors.c_str(), stderr);
+    if (r.failed) status = EXIT_FAILURE;
+    empty |= r.empty;
+  }
+  for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+
+  // log-util.py tells a device without a log from a failure by this status
+  if (status == EXIT_SUCCESS && empty) status = NO_LOG_STATUS;
+  return status;
+}
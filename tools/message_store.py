@@ -17,12 +17,22 @@ import sys
 from datetime import datetime
 import myriota_auth
 import requests
+import csv
 import json
+import os
+import threading
 import time
+try:
+    import queue
+except ImportError:
+    import Queue as queue
 
 _domain = "https://api.myriota.com/v1"
 
-def do_query(idtoken, moduleid, range_from=None, limit=None):
+# Messages already exported, by module
+CACHE_DIR = myriota_auth.TOKEN_DIR + '/messages'
+
+def do_query(idtoken, moduleid, range_from=None, limit=None, session=None):
     params = []
     if range_from:
         params.append("from={}".format(range_from))
@@ -30,12 +40,202 @@ def do_query(idtoken, moduleid, range_from=None, limit=None):
         params.append("limit={}".format(limit))
 
     url = "?".join(["%s/data/%s/Message" % (_domain, moduleid), "&".join(params)])
-    response = requests.get(url, headers={"Authorization": idtoken})
+    response = (session or requests).get(url, headers={"Authorization": idtoken})
 
     if response.status_code != 200:
         raise ValueError(response.text)
     return response.json()["Items"]
 
+def message_key(item):
+    return json.dumps(item, sort_keys=True)
+
+def iter_messages(get_idtoken, moduleid, range_from=0, limit=100, session=None,
+                  seen=()):
+    """Generator of the pages of messages of a module from range_from.
+
+    Pages are followed from the Timestamp of the last message of the previous
+    page, skipping the messages at that time already returned, as are those in
+    seen. Raises ValueError if a full page holds no new messages, as more than
+    limit messages share a Timestamp and those after them cannot be reached.
+    """
+    seen = set(seen)
+    while True:
+        items = do_query(get_idtoken(), moduleid, range_from, limit, session)
+        page = [i for i in items if message_key(i) not in seen]
+        if page:
+            yield page
+        elif len(items) == limit:
+            raise ValueError("More than %d messages at %s, use a larger limit" %
+                             (limit, range_from))
+        if len(items) < limit or not page or "Timestamp" not in items[-1]:
+            return
+        range_from = items[-1]["Timestamp"]
+        seen = set(message_key(i) for i in items
+                   if i.get("Timestamp") == range_from)
+
+class MessageCache(object):
+    """Messages of a module exported from a time onwards, as newline delimited
+    JSON in CACHE_DIR, appended to as pages are fetched."""
+
+    def __init__(self, moduleid, range_from, directory=CACHE_DIR):
+        name = "".join(c if c.isalnum() else "_" for c in moduleid)
+        self.path = os.path.join(directory, name + ".json")
+        self.meta_path = os.path.join(directory, name + ".meta")
+        try:
+            os.makedirs(directory)
+        except OSError:
+            if not os.path.isdir(directory):
+                raise
+        try:
+            with open(self.meta_path) as f:
+                self.start = json.load(f)["From"]
+            valid = self.start <= range_from
+        except (IOError, ValueError, KeyError, TypeError):
+            valid = False
+        if not valid or not os.path.exists(self.path):
+            # starts earlier than the cache, so fetch everything again
+            self.start = range_from
+            open(self.path, "w").close()
+            with open(self.meta_path, "w") as f:
+                json.dump({"From": range_from}, f)
+
+    def read(self, limit):
+        """Generator of pages of the cached messages. A partial line left by an
+        interrupted export is dropped."""
+        with open(self.path, "r+") as f:
+            page = []
+            while True:
+                offset = f.tell()
+                line = f.readline()
+                if not line:
+                    break
+                try:
+                    if not line.endswith("\n"):
+                        raise ValueError
+                    item = json.loads(line)
+                except ValueError:
+                    f.truncate(offset)
+                    break
+                page.append(item)
+                if len(page) == limit:
+                    yield page
+                    page = []
+            if page:
+                yield page
+
+    def append(self, items):
+        with open(self.path, "a") as f:
+            for i in items:
+                f.write(json.dumps(i) + "\n")
+
+class NdjsonWriter(object):
+    def __init__(self, f):
+        self.f = f
+
+    def write(self, moduleid, items):
+        for i in items:
+            line = dict(i)
+            line.setdefault("ModuleId", moduleid)
+            self.f.write(json.dumps(line) + "\n")
+        self.f.flush()
+
+class CsvWriter(object):
+    """Columns are ModuleId and the fields of the first message"""
+
+    def __init__(self, f):
+        self.f = f
+        self.writer = None
+
+    def write(self, moduleid, items):
+        for i in items:
+            if self.writer is None:
+                columns = ["ModuleId"] + sorted(k for k in i if k != "ModuleId")
+                self.writer = csv.DictWriter(self.f, columns,
+                                             extrasaction="ignore")
+                self.writer.writeheader()
+            row = dict((k, v if not isinstance(v, (dict, list))
+                        else json.dumps(v)) for k, v in i.items())
+            row.setdefault("ModuleId", moduleid)
+            self.writer.writerow(row)
+        self.f.flush()
+
+def export_module(get_idtoken, moduleid, range_from, limit, write, session=None,
+                  use_cache=True):
+    """Write the messages of a module from range_from with write, from the cache
+    and then the Message Store. Returns the number of messages written."""
+    count = 0
+    cache = None
+    seen = []
+    start = range_from
+    if use_cache:
+        cache = MessageCache(moduleid, range_from)
+        # the cache covers every message from its start, even if it is empty
+        start = cache.start
+        for page in cache.read(limit):
+            last = page[-1].get("Timestamp", start)
+            if last != start:
+                seen = []
+                start = last
+            seen += [message_key(i) for i in page
+                     if i.get("Timestamp") == last]
+            page = [i for i in page if i.get("Timestamp", 0) >= range_from]
+            if page:
+                write(moduleid, page)
+                count += len(page)
+    # fetched from the end of the cache, or its start if empty, even if before
+    # range_from, so the cache has no gaps
+    for page in iter_messages(get_idtoken, moduleid, start, limit, session,
+                              seen):
+        if cache is not None:
+            cache.append(page)
+        page = [i for i in page if i.get("Timestamp", 0) >= range_from]
+        if page:
+            write(moduleid, page)
+            count += len(page)
+    return count
+
+def export(get_idtoken, moduleids, range_from, limit, writer, jobs=8,
+           use_cache=True):
+    """Export the messages of modules concurrently, each worker reusing the
+    connections of a session. Returns the number of messages exported and a
+    dict of the errors by module."""
+    lock = threading.Lock()
+    todo = queue.Queue()
+    for m in moduleids:
+        todo.put(m)
+    result = {"count": 0, "errors": {}}
+
+    def write(moduleid, items):
+        with lock:
+            writer.write(moduleid, items)
+
+    def work():
+        session = requests.Session()
+        while True:
+            try:
+                moduleid = todo.get_nowait()
+            except queue.Empty:
+                return
+            try:
+                n = export_module(get_idtoken, moduleid, range_from, limit,
+                                  write, session, use_cache)
+                with lock:
+                    result["count"] += n
+            except Exception as e:
+                # any failure, e.g. a response without Items, is recorded for
+                # the module rather than ending the worker
+                with lock:
+                    result["errors"][moduleid] = str(e)
+
+    workers = [threading.Thread(target=work)
+               for _ in range(max(1, min(jobs, len(moduleids))))]
+    for w in workers:
+        w.daemon = True
+        w.start()
+    for w in workers:
+        w.join()
+    return result["count"], result["errors"]
+
 def main(argv=None, auth=myriota_auth.auth):
     """CLI entrypoint."""
     import getpass
@@ -53,6 +253,18 @@ def main(argv=None, auth=myriota_auth.auth):
     sub_parser.add_argument("moduleid", help="Module Id")
     sub_parser.add_argument("-f", "--from", dest="range_from", type=int, default=0, help="Unix epoch second to start query from")
     sub_parser.add_argument("-l", "--limit", type=int, default=100, help="Maximum number of entries to return")
+    sub_parser = subparsers.add_parser(
+        'export', help="Export all messages of modules",
+        description="Export all messages of modules, fetching them concurrently and following pagination. Messages are cached so later exports only fetch new messages."
+    )
+    sub_parser.add_argument("moduleids", nargs="*", help="Module Ids")
+    sub_parser.add_argument("-i", "--input", help="FILE of Module Ids, one per line", metavar="FILE")
+    sub_parser.add_argument("-o", "--output", default="-", help="FILE to write to, standard output by default", metavar="FILE")
+    sub_parser.add_argument("-t", "--format", choices=["ndjson", "csv"], default="ndjson", help="Newline delimited JSON, or CSV with a column for each field of the first message")
+    sub_parser.add_argument("-f", "--from", dest="range_from", type=int, default=0, help="Unix epoch second to start export from")
+    sub_parser.add_argument("-l", "--limit", type=int, default=100, help="Maximum number of entries per request")
+    sub_parser.add_argument("-j", "--jobs", type=int, default=8, help="Number of modules fetched at once")
+    sub_parser.add_argument("-n", "--no-cache", dest="use_cache", action="store_false", help="Neither use nor update the cache in %s" % CACHE_DIR)
 
     args = parser.parse_args(argv)
 
@@ -65,8 +277,31 @@ def main(argv=None, auth=myriota_auth.auth):
         idtoken = auth()['IdToken']
         items = do_query(idtoken, args.moduleid, range_from, args.limit)
         return json.dumps(items, indent=2)
+    elif args.command == "export":
+        moduleids = list(args.moduleids)
+        if args.input:
+            with open(args.input) as f:
+                moduleids += [l.strip() for l in f if l.strip()]
+        moduleids = sorted(set(moduleids), key=moduleids.index)
+        if not moduleids:
+            sys.exit("No Module Ids to export")
+        get_idtoken = myriota_auth.auto_auth(authenticate=auth)
+        output = sys.stdout if args.output == "-" else open(args.output, "w")
+        writer = (CsvWriter if args.format == "csv" else NdjsonWriter)(output)
+        count, errors = export(lambda: get_idtoken()['IdToken'], moduleids,
+                               args.range_from * 1000, args.limit, writer,
+                               args.jobs, args.use_cache)
+        if output is not sys.stdout:
+            output.close()
+        sys.stderr.write("Exported %d messages of %d modules\n"
+                         % (count, len(moduleids) - len(errors)))
+        if errors:
+            sys.exit("\n".join("Failed to export %s: %s" % e
+                                for e in sorted(errors.items())))
     else:
         return "Invalid command"
 
 if __name__ == "__main__":
-    print(main())
+    out = main()
+    if out is not None:
+        print(out)
@@ -0,0 +1,185 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MULTICHANNEL_H
+#define MULTICHANNEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "math/myriotamath.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Resamples several independent channels of interleaved complex samples, i.e.
+// sample i of channel c is at index i * channels + c. Every channel has its
+// own BasicPolyphaseResampler. Channels are statically assigned to a pool of
+// workers, channel c to worker c % threads. Worker 0 is the thread calling
+// process, which also does the I/O, the others are pool threads. On Linux
+// worker w is pinned to the w-th CPU the process is allowed to run on, e.g. by
+// taskset or a cpuset, the caller on its first call to process, so the state
+// of a channel stays in the cache of one core and the caller does not migrate
+// onto the core of a pool worker.
+//
+// All channels have the same rates and see the same number of input samples,
+// so each produces the same number of output samples per block.
+template <typename T>
+class MultiChannelResampler {
+ public:
+  typedef std::complex<T> sample;
+  const unsigned int channels;
+  const unsigned int threads;
+
+  MultiChannelResampler(unsigned int channels, unsigned int threads,
+                        double in_rate, double out_rate, double W = 30)
+      : channels(channels),
+        threads(std::max(1u, std::min(threads, channels))),
+        in(channels),
+        out(channels),
+        written(channels),
+        generation(0),
+        pending(0),
+        stop(false) {
+#ifdef __linux__
+    // before any pinning narrows the affinity of this thread
+    caller_pinned = false;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      CPU_ZERO(&allowed);
+#endif
+    for (unsigned int c = 0; c < channels; c++)
+      r.push_back(myriota::BasicPolyphaseResampler<T>(in_rate, out_rate, W));
+    for (unsigned int w = 1; w < this->threads; w++)
+      workers.push_back(std::thread(&MultiChannelResampler::worker, this, w));
+  }
+
+  ~MultiChannelResampler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    start.notify_all();
+    for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+  }
+
+  // Upper bound on the number of output samples per channel written by
+  // process(in, n_in, out).
+  size_t max_output(size_t n_in) const { return r[0].max_output(n_in); }
+
+  // Push n_in interleaved samples per channel from x and write the
+  // interleaved output samples into y, which must have room for
+  // max_output(n_in) * channels samples. Returns the number of output samples
+  // per channel written.
+  size_t process(const sample *x, size_t n_in, sample *y) {
+#ifdef __linux__
+    if (!caller_pinned) {
+      pin(0);
+      caller_pinned = true;
+    }
+#endif
+    n = n_in;
+    n_out = max_output(n_in);
+    source = x;
+    destination = y;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending = threads - 1;
+      generation++;
+    }
+    start.notify_all();
+    run(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    return written[0];
+  }
+
+ protected:
+  std::vector<myriota::BasicPolyphaseResampler<T>> r;
+  std::vector<std::vector<sample>> in;
+  std::vector<std::vector<sample>> out;
+  std::vector<size_t> written;  // output samples of each channel this block
+  std::vector<std::thread> workers;
+
+  // current block, written by process before starting the workers
+  const sample *source;
+  sample *destination;
+  size_t n;
+  size_t n_out;
+
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  uint64_t generation;
+  unsigned int pending;
+  bool stop;
+
+#ifdef __linux__
+  cpu_set_t allowed;  // CPUs of the process when constructed
+  bool caller_pinned;
+#endif
+
+  // Resample the channels assigned to worker w for the current block
+  void run(unsigned int w) {
+    for (unsigned int c = w; c < channels; c += threads) {
+      in[c].resize(n);
+      out[c].resize(n_out);
+      for (size_t i = 0; i < n; i++) in[c][i] = source[i * channels + c];
+      written[c] = r[c].process(in[c].data(), n, out[c].data());
+      for (size_t i = 0; i < written[c]; i++)
+        destination[i * channels + c] = out[c][i];
+    }
+  }
+
+#ifdef __linux__
+  // Pin the calling thread to the w-th allowed CPU, wrapping around. Returns
+  // false and leaves the thread free to run on any allowed CPU if failed.
+  bool pin(unsigned int w) const {
+    const int cpus = CPU_COUNT(&allowed);
+    if (cpus <= 0) return false;
+    int k = w % cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (!CPU_ISSET(cpu, &allowed) || k-- > 0) continue;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    return false;
+  }
+#endif
+
+  void worker(unsigned int w) {
+#ifdef __linux__
+    pin(w);
+#endif
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start.wait(lock, [this, seen] { return stop || generation != seen; });
+        if (stop) return;
+        seen = generation;
+      }
+      run(w);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) done.notify_one();
+    }
+  }
+};
+
+#endif
@@ -5,6 +5,7 @@ import getpass
 import requests
 import sys
 import os
+import threading
 import time
 
 CLIENT_ID = "4jskgo1eq6ngcimlseerg50uvd"
@@ -82,15 +83,17 @@ def auth():
         return token
 
 
-def auto_auth(refresh=3600):
-    '''Returns a function that returns a periodically refreshed token'''
-    s = {'t': auth(), 'e': 0 }
+def auto_auth(refresh=3600, authenticate=auth):
+    '''Returns a thread safe function that returns a periodically refreshed token'''
+    s = {'t': authenticate(), 'e': 0 }
     s['e'] = time.time() + min(refresh, s['t']['ExpiresIn']*0.9)
+    lock = threading.Lock()
     def f():
-        if time.time() > s['e']:
-            s['t'] = auth()
-            s['e'] = time.time() + min(refresh, s['t']['ExpiresIn']*0.9)
-        return s['t']
+        with lock:
+            if time.time() > s['e']:
+                s['t'] = authenticate()
+                s['e'] = time.time() + min(refresh, s['t']['ExpiresIn']*0.9)
+            return s['t']
     return f
 
 if __name__ == '__main__':
@@ -0,0 +1,25 @@
+// Copyright (c) 2016-2019, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// LogAdd user error codes written by terminal/profile, from PROFILE_LOG_CODE,
+// in the format of log_codes.h. User codes belong to the application, so these
+// are only decoded when asked for with the --profile option of log_decoder and
+// log-util.py. terminal/profile/profile.h takes PROFILE_LOG_CODE from here, so
+// it is defined in this file only.
+
+#define PROFILE_LOG_CODE 120
+
+LOG_CODE(PROFILE_LOG_CODE + 0, "Profile job", "<IIIIII", "Job", "Address", "Runs", "Wakeups", "Ticks", "Max ticks")
+LOG_CODE(PROFILE_LOG_CODE + 1, "Profile GNSS", "<IIII", "Fixes", "Failures", "Ticks", "Max ticks")
+LOG_CODE(PROFILE_LOG_CODE + 2, "Profile delay", "<IIII", "Delays", "Delay ticks", "Sleeps", "Sleep seconds")
+LOG_CODE(PROFILE_LOG_CODE + 3, "Profile events", "<IIBBHIIBBHIIBBHIIBBH", "Time 1", "Ticks 1", "Kind 1", "Job 1", "Reserved 1", "Time 2", "Ticks 2", "Kind 2", "Job 2", "Reserved 2", "Time 3", "Ticks 3", "Kind 3", "Job 3", "Reserved 3", "Time 4", "Ticks 4", "Kind 4", "Job 4", "Reserved 4")
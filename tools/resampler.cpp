@@ -15,36 +15,67 @@
 #include <stdlib.h>
 #include <complex>
 #include <cstdint>
+#include <vector>
 #include "math/myriotamath.h"
 #include "tools/cmdline.h"
+#include "tools/multichannel.h"
 
 using namespace myriota;
 
-// Read complex sample from file
-int read_sample(FILE *infile, myriota::complex &sample) {
-  double buf[2];
-  if (fread(buf, sizeof(double), 2, infile) < 2) return -1;
-  sample = myriota::complex(buf[0], buf[1]);
-  return 0;
+// Read up to n complex samples from file, returns number of complete samples
+template <typename T>
+size_t read_samples(FILE *infile, std::complex<T> *samples, size_t n) {
+  return fread(reinterpret_cast<T *>(samples), 2 * sizeof(T), n, infile);
 }
 
-// write complex sample to stdout
-void write_sample(const myriota::complex &sample) {
-  const double buf[2] = {std::real(sample), std::imag(sample)};
-  if (fwrite(buf, sizeof(double), 2, stdout) == 2) return;
-  fprintf(stderr, "resampler failed to write sample\n");
+// write n complex samples to stdout
+template <typename T>
+void write_samples(const std::complex<T> *samples, size_t n) {
+  if (fwrite(reinterpret_cast<const T *>(samples), 2 * sizeof(T), n,
+             stdout) == n)
+    return;
+  fprintf(stderr, "resampler failed to write samples\n");
   exit(EXIT_FAILURE);
 }
 
-template <class R>
-void resample(FILE *infile, R &r) {
-  for (int64_t n = 0; n >= 0; n++) {
-    while (r.maxn() < n) {
-      complex x;
-      if (read_sample(infile, x)) return;
-      r.push(x);
-    }
-    write_sample(r(n));
+template <typename T>
+void resample(FILE *infile, BasicPolyphaseResampler<T> &r, size_t block_size) {
+  std::vector<std::complex<T>> in(block_size);
+  std::vector<std::complex<T>> out(r.max_output(block_size));
+  size_t n_in;
+  while ((n_in = read_samples(infile, in.data(), block_size)) > 0) {
+    out.resize(r.max_output(n_in));
+    const size_t n_out = r.process(in.data(), n_in, out.data());
+    write_samples(out.data(), n_out);
+  }
+}
+
+// Resample interleaved channels, reading block_size samples per channel at a
+// time
+template <typename T>
+void resample(FILE *infile, MultiChannelResampler<T> &r, size_t block_size) {
+  const size_t channels = r.channels;
+  std::vector<std::complex<T>> in(block_size * channels);
+  std::vector<std::complex<T>> out(r.max_output(block_size) * channels);
+  size_t n_in;
+  while ((n_in = fread(in.data(), 2 * sizeof(T) * channels, block_size,
+                       infile)) > 0) {
+    out.resize(r.max_output(n_in) * channels);
+    const size_t n_out = r.process(in.data(), n_in, out.data());
+    write_samples(out.data(), n_out * channels);
+  }
+}
+
+// Resample with the requested number of channels and threads
+template <typename T>
+void resample(FILE *infile, double in_rate, double out_rate, double W,
+              size_t block_size, unsigned int channels, unsigned int threads) {
+  if (channels == 1) {
+    BasicPolyphaseResampler<T> r(in_rate, out_rate, W);
+    resample(infile, r, block_size);
+  } else {
+    MultiChannelResampler<T> r(channels, threads, in_rate, out_rate, W);
+    resample(infile, r, block_size);
   }
 }
 
@@ -55,24 +86,45 @@ int main(int argc, char **argv) {
   cmd_parser.add<double>("output_rate", 'r', "output sample rate", true);
   cmd_parser.add<double>("window_width", 'W',
                          "larger is slower, but more accurate", false, 30);
+  cmd_parser.add<size_t>("block-size", 'b',
+                         "number of samples read and written at a time", false,
+                         65536, cmdline::range<size_t>(1, 1 << 24));
+  cmd_parser.add<std::string>(
+      "precision", 'p',
+      "precision of samples and arithmetic, also the sample format", false,
+      "double", cmdline::oneof<std::string>("double", "float"));
+  cmd_parser.add<unsigned int>(
+      "channels", 'c', "number of interleaved channels resampled independently",
+      false, 1, cmdline::range<unsigned int>(1, 1024));
+  cmd_parser.add<unsigned int>("threads", 't',
+                               "number of threads used for multiple channels, "
+                               "0 for one per CPU",
+                               false, 0);
   cmd_parser.set_description(
       "Resamples double precision complex samples from input rate to output\n"
-      "rate. Input samples via stdin, output samples are written to stdout.\n");
+      "rate. Input samples via stdin, output samples are written to stdout.\n"
+      "With --precision float samples are single precision instead. With\n"
+      "--channels N the input holds N interleaved channels, i.e. sample i of\n"
+      "channel c is the (i * N + c)th sample, and the output is interleaved\n"
+      "likewise.\n");
 
   cmd_parser.parse_check(argc, argv);
 
   const double in_rate = cmd_parser.get<double>("input_rate");
   const double out_rate = cmd_parser.get<double>("output_rate");
   const double W = cmd_parser.get<double>("window_width");
+  const size_t block_size = cmd_parser.get<size_t>("block-size");
+  const std::string precision = cmd_parser.get<std::string>("precision");
+  const unsigned int channels = cmd_parser.get<unsigned int>("channels");
+  unsigned int threads = cmd_parser.get<unsigned int>("threads");
+  if (threads == 0) threads = std::thread::hardware_concurrency();
 
-  /// Upsampler or downsampler as required
-  if (in_rate <= out_rate) {
-    Upsampler r = Upsampler(in_rate, out_rate, W);
-    resample(stdin, r);
-  } else {
-    Downsampler r = Downsampler(in_rate, out_rate, W);
-    resample(stdin, r);
-  }
+  if (precision == "float")
+    resample<float>(stdin, in_rate, out_rate, W, block_size, channels,
+                    threads);
+  else
+    resample<double>(stdin, in_rate, out_rate, W, block_size, channels,
+                     threads);
 
   return EXIT_SUCCESS;
 }
@@ -27,6 +27,34 @@ import sys
 import time
 from threading import Timer, Thread
 from uuid import uuid4
+try:
+    from queue import Queue
+except ImportError:
+    from Queue import Queue
+
+
+# file extension and default level of each compression codec
+codec_extensions = {'bz2': 'bz2', 'zstd': 'zst', 'lz4': 'lz4'}
+codec_levels = {'bz2': 9, 'zstd': 3, 'lz4': 0}
+
+
+class LZ4Compressor(object):
+    '''Streaming lz4 frame compressor with the interface of BZ2Compressor.'''
+
+    def __init__(self, level):
+        import lz4.frame
+        self.compressor = lz4.frame.LZ4FrameCompressor(compression_level=level)
+        self.header = self.compressor.begin()
+
+    def compress(self, data):
+        out = self.header + self.compressor.compress(data)
+        self.header = b''
+        return out
+
+    def flush(self):
+        out = self.header + self.compressor.flush()
+        self.header = b''
+        return out
 
 
 class SatelliteSimulator(object):
@@ -40,7 +68,9 @@ class SatelliteSimulator(object):
         self, frequency=434e6, rate=250e3, down_rate=5e3, gain=33.8,
         chunk_duration=60,
         api_url='https://api.myriota.com/v1/spectrum/ingest/',
-        id=None, url_token=lambda: None
+        id=None, url_token=lambda: None,
+        compression='bz2', compression_level=None, delta=False,
+        workers=2, max_pending=4
     ):
         # endpoint and token for capture upload
         self.api_url = api_url.strip('/')
@@ -59,21 +89,39 @@ class SatelliteSimulator(object):
         self.chunk_duration = chunk_duration
         self.chunk_size = int(self.chunk_duration * self.down_rate * 4)
 
-        # tools convert_type and resampler assumed to reside in current folder
+        # chunk compression, optionally delta coded by capture_pipeline first
+        if compression not in codec_extensions:
+            raise ValueError('Unknown compression ' + compression)
+        self.compression = compression
+        self.compression_level = compression_level \
+            if compression_level is not None else codec_levels[compression]
+        self.compression_block = 1 << 20
+        self.delta = delta
+
+        # threads compressing chunks, and chunks waiting for each stage
+        self.workers = max(1, workers)
+        self.max_pending = max(1, max_pending)
+
+        # tools capture_pipeline, convert_type and resampler assumed to reside
+        # in current folder
         os.environ["PATH"] += os.pathsep + os.getcwd()
 
     def check_dongle(self):
         '''
-        Check if rtl_sdr, convert_type and resampler tools are installed and
-        device available. No need to reimplement dongle search as rtl_sdr
-        already does this. Returns True on success.
+        Check if rtl_sdr and either capture_pipeline or the convert_type and
+        resampler tools are installed and device available. No need to
+        reimplement dongle search as rtl_sdr already does this. Returns True on
+        success.
         '''
         if find_executable('rtl_sdr') is None:
             raise IOError('rtl_sdr: command not found. Please check your installation.')
-        if find_executable('convert_type') is None:
-            raise IOError('convert_type: command not found. Please check your installation.')
-        if find_executable('resampler') is None:
-            raise IOError('resampler: command not found. Please check your installation.')
+        if find_executable('capture_pipeline') is None:
+            if find_executable('convert_type') is None:
+                raise IOError('convert_type: command not found. Please check your installation.')
+            if find_executable('resampler') is None:
+                raise IOError('resampler: command not found. Please check your installation.')
+            if self.delta:
+                raise IOError('capture_pipeline: command not found, needed for delta coding.')
         proc = subprocess.Popen('rtl_sdr -n 1 - > /dev/null', shell=True, stderr=subprocess.PIPE)
         _, stderr = proc.communicate()
         if proc.returncode != 0:
@@ -85,94 +133,157 @@ class SatelliteSimulator(object):
         Initiate signal capture and processing chain. Samples are written to
         stdout attribute of the returned subprocess.Popen object. Units of the
         duration is seconds, with zero corresponding to capturing indefinitely.
+        Uses capture_pipeline if installed, which converts, resamples and
+        quantises in a single process and writes whole chunks at a time. Delta
+        coding requires capture_pipeline.
         '''
-        cmd = [
-            'rtl_sdr -f {frequency} -s {rate} -g {gain} -n {samples} -',
-            'convert_type -f uint8',
-            'resampler -i {rate} -r {down_rate}',
-            'convert_type -t int16'
-        ]
+        if find_executable('capture_pipeline') is not None:
+            cmd = [
+                'rtl_sdr -f {frequency} -s {rate} -g {gain} -n {samples} -',
+                'capture_pipeline -i {rate} -r {down_rate} -c {chunk_samples}'
+                + (' -d' if self.delta else '')
+            ]
+        elif self.delta:
+            raise IOError('capture_pipeline: command not found, needed for delta coding.')
+        else:
+            cmd = [
+                'rtl_sdr -f {frequency} -s {rate} -g {gain} -n {samples} -',
+                'convert_type -f uint8',
+                'resampler -i {rate} -r {down_rate}',
+                'convert_type -t int16'
+            ]
         cmd = ' | '.join(cmd).format(
             frequency=self.frequency,
             rate=self.rate,
             gain=self.gain,
             down_rate=self.down_rate,
-            samples=int(duration * self.rate)
+            samples=int(duration * self.rate),
+            chunk_samples=self.chunk_size // 4
         )
         return subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE)
 
     def process_capture(self, capture):
         '''
         Reads samples from stdout of the provided subprocess.Popen object
-        capture and splits the stream into chunks. Internally invokes the
-        function process_chunk for each chunk.
+        capture and splits the stream into chunks. Chunks are compressed by a
+        pool of worker threads and uploaded by another thread, so compression
+        of one chunk overlaps the upload of the previous one. At most
+        max_pending chunks wait for each stage, beyond which reading from the
+        capture blocks. Chunks are read straight into a pool of preallocated
+        buffers that are recycled once compressed, so samples are not copied
+        before compression.
 
-        This function does not return until termination of the capture process.
+        This function does not return until termination of the capture process
+        and upload of every chunk.
         '''
-        chunk = BytesIO()
-        threads = []
-        while True:
-            returncode = capture.poll()
-            if returncode == None:
-                buffer = capture.stdout.read(64)
-                while len(buffer) >= self.chunk_size - chunk.tell():
-                    bytes = self.chunk_size - chunk.tell()
-                    chunk.write(buffer[0:bytes])
-                    t = Thread(target=self.process_chunk, args=[chunk])
-                    threads.append(t)
-                    t.start()
-                    # remove written portion from buffer, then move on to next chunk
-                    buffer = buffer[bytes:]
-                    chunk = BytesIO()
-                chunk.write(buffer)
-            elif returncode == 0:
-                # capture process completed successfully -> process remaining samples
-                buffer = capture.stdout.read()
-                while len(buffer) >= self.chunk_size - chunk.tell():
-                    bytes = self.chunk_size - chunk.tell()
-                    chunk.write(buffer[0:bytes])
-                    t = Thread(target=self.process_chunk, args=[chunk])
-                    threads.append(t)
-                    t.start()
-                    # remove written portion from buffer, then move on to next chunk
-                    buffer = buffer[bytes:]
-                    chunk = BytesIO()
-                chunk.write(buffer)
-                if chunk.tell() > 0:
-                    t = Thread(target=self.process_chunk, args=[chunk])
-                    threads.append(t)
-                    t.start()
+        chunks = Queue(self.max_pending)
+        uploads = Queue(self.max_pending)
+        # enough buffers for every waiting chunk, every worker and the reader
+        pool = Queue()
+        for _ in range(self.max_pending + self.workers + 1):
+            pool.put(bytearray(self.chunk_size))
+        compressors = [Thread(target=self.compress_worker,
+                              args=[chunks, uploads, pool])
+                       for _ in range(self.workers)]
+        uploader = Thread(target=self.upload_worker, args=[uploads])
+        for t in compressors + [uploader]:
+            t.daemon = True
+            t.start()
+        try:
+            while True:
+                # blocks until a whole chunk is available or the capture ends
+                buffer = pool.get()
+                length = self.read_chunk(capture.stdout, buffer)
+                if length < self.chunk_size:
+                    returncode = capture.wait()
+                    if returncode != 0:
+                        raise IOError('Error: signal capture terminated with exit code {}.'.format(returncode))
+                    # capture process completed successfully -> process remaining samples
+                    if length > 0:
+                        chunks.put((buffer, length, self.get_time()))
+                    break
+                chunks.put((buffer, length, self.get_time()))
+        finally:
+            # finish the chunks already read
+            for _ in compressors:
+                chunks.put(None)
+            [t.join() for t in compressors]
+            uploads.put(None)
+            uploader.join()
+
+    def read_chunk(self, stream, buffer):
+        '''
+        Fills buffer from stream with readinto. Returns the number of bytes
+        read, which is less than the size of buffer only at the end of stream.
+        '''
+        view = memoryview(buffer)
+        length = 0
+        while length < len(view):
+            n = stream.readinto(view[length:])
+            if not n:
                 break
-            else:
-                raise IOError('Error: signal capture terminated with exit code {}.'.format(returncode))
-            # clear out finished threads
-            threads = [t for t in threads if t.is_alive()]
-        # wait for remaining threads to finished
-        [t.join() for t in threads]
+            length += n
+        return length
 
-    def process_chunk(self, chunk):
+    def compress_worker(self, chunks, uploads, pool):
         '''
-        Compresses a chunk of samples with bzip2. Internally invokes function
-        upload_chunk.
+        Compresses chunks of samples from queue chunks until None, and queues
+        them for upload. Buffers are returned to pool once compressed.
         '''
-        chunk.seek(0)
-        compressed = bz2.compress(chunk.read(), 9)
-        chunk.seek(0)
-        chunk.write(compressed)
-        chunk.truncate()
-        try:
-            self.upload_chunk(chunk)
-        except Exception as e:
-            # tell the user if upload fails, but attempt to keep going
-            print('Upload failed:' + str(e), file=sys.stderr)
-        finally:
-            chunk.close()
+        while True:
+            item = chunks.get()
+            if item is None:
+                return
+            buffer, length, timestamp = item
+            try:
+                compressed = self.compress_chunk(memoryview(buffer)[:length])
+                uploads.put((compressed, timestamp))
+            except Exception as e:
+                print('Compression failed:' + str(e), file=sys.stderr)
+            finally:
+                pool.put(buffer)
+
+    def upload_worker(self, uploads):
+        '''Uploads compressed chunks from queue uploads until None.'''
+        while True:
+            item = uploads.get()
+            if item is None:
+                return
+            compressed, timestamp = item
+            try:
+                self.upload_chunk(BytesIO(compressed), timestamp)
+            except Exception as e:
+                # tell the user if upload fails, but attempt to keep going
+                print('Upload failed:' + str(e), file=sys.stderr)
+
+    def compressor(self):
+        '''Returns a streaming compressor for the configured codec.'''
+        if self.compression == 'zstd':
+            import zstandard
+            return zstandard.ZstdCompressor(
+                level=self.compression_level).compressobj()
+        if self.compression == 'lz4':
+            return LZ4Compressor(self.compression_level)
+        return bz2.BZ2Compressor(self.compression_level)
+
+    def compress_chunk(self, buffer):
+        '''
+        Compresses a buffer of samples a block at a time, without copying it.
+        Returns the compressed bytes.
+        '''
+        compressor = self.compressor()
+        view = memoryview(buffer)
+        out = [compressor.compress(view[i:i + self.compression_block])
+               for i in range(0, len(view), self.compression_block)]
+        out.append(compressor.flush())
+        return b''.join(out)
 
-    def upload_chunk(self, chunk):
+    def upload_chunk(self, chunk, timestamp=None):
         '''
-        Uploads the provided chunk of samples to a presigned URL.
+        Uploads the provided chunk of samples to a presigned URL. The timestamp
+        is the time at which the end of the chunk was captured, default now.
         '''
-        upload_url = self.upload_url()
+        upload_url = self.upload_url(timestamp)
         chunk.seek(0)
         headers = {'Content-Type': ''}
         upload = requests.put(upload_url, headers=headers, data=chunk)
@@ -181,13 +292,18 @@ class SatelliteSimulator(object):
     def get_time(self):
         return time.time()
 
-    def upload_url(self):
+    def upload_url(self, timestamp=None):
         '''
-        Returns a presigned URL for uploading a chunk of samples.
+        Returns a presigned URL for uploading a chunk of samples, whose end was
+        captured at timestamp, default now.
         '''
+        if timestamp is None:
+            timestamp = self.get_time()
         # timestamp with 100 µs resolution, backdated by the duration of the chunk
-        timestamp = int((self.get_time() - self.chunk_duration) * 1e4)
-        acquisition_id = '{id}_{ts}.bz2'.format(id=self.id, ts=timestamp)
+        timestamp = int((timestamp - self.chunk_duration) * 1e4)
+        acquisition_id = '{id}_{ts}{delta}.{ext}'.format(
+            id=self.id, ts=timestamp, delta='.delta' if self.delta else '',
+            ext=codec_extensions[self.compression])
         auth_header = {'Authorization': '{token}'.format(token=self.url_token())}
         get_params = {
             'AcqID': acquisition_id,
@@ -233,9 +349,19 @@ if __name__ == '__main__':
     parser = argparse.ArgumentParser(description=SatelliteSimulator.__doc__)
     parser.add_argument('-d', '--duration', type=float, default=0,
       help='Duration of the simulation in seconds. Runs indefinitely if set to zero (default).')
+    parser.add_argument('-c', '--compression', default='bz2', choices=sorted(codec_extensions),
+      help='Compression of uploaded chunks, zstd and lz4 need the zstandard and lz4 packages (default bz2).')
+    parser.add_argument('-l', '--level', type=int, default=None,
+      help='Compression level, default 9 for bz2, 3 for zstd and 0 for lz4.')
+    parser.add_argument('--delta', action='store_true', default=False,
+      help='Delta code samples before compression, requires capture_pipeline.')
+    parser.add_argument('-w', '--workers', type=int, default=2,
+      help='Number of threads compressing chunks (default 2).')
     args = parser.parse_args()
 
-    simulator = SatelliteSimulatorAuth()
+    simulator = SatelliteSimulatorAuth(
+        compression=args.compression, compression_level=args.level,
+        delta=args.delta, workers=args.workers)
     try:
         simulator.check_dongle()
         simulator.login()
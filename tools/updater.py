@@ -19,7 +19,17 @@ import sys
 import time
 import serial
 import argparse
+import binascii
+import json
 import os
+import threading
+import zlib
+
+# Hashes of the pages of the images last programmed, by device and command
+MANIFEST_DIR = os.path.expanduser("~") + '/.cache/myriota/updater'
+
+# USB vendor IDs of the serial adapters in terminal/g2/99-myriota-g2.rules
+DEVICE_VIDS = [0x067b, 0x0403, 0x1366, 0x10c4]
 
 
 def open_serial_port(portname):
@@ -57,6 +67,11 @@ def wait_for_serial_port(portname):
             time.sleep(0.5)
             pass
 
+def find_serial_ports():
+    import serial.tools.list_ports
+    return sorted(p.device for p in serial.tools.list_ports.comports()
+                  if p.vid in DEVICE_VIDS)
+
 def capture_bootloader(ser):
     # return straightaway if already in bootloader
     ser.reset_input_buffer()
@@ -67,7 +82,7 @@ def capture_bootloader(ser):
         out += ser.readline()
         out += ser.readline()
     if b'Unknown' in out or b'Bootloader' in out:
-        return
+        return True
     print('Please reset the device', end='')
     sys.stdout.flush()
     ser.reset_input_buffer()
@@ -91,33 +106,37 @@ def capture_bootloader(ser):
         retries += 1
         if retries > MAX_RETRIES:
             sys.stderr.write('failed to connect to the board\n')
-            sys.exit(1)
+            return False
         time.sleep(0.5)
         print('.', end='')
         sys.stdout.flush()
 
     ser.reset_input_buffer()
+    return True
 
 
+# CRC-16/XMODEM, table driven in C by binascii
 def calc_crc(data):
-    crc = 0
-    for b in data:
-        crc = crc ^ (b << 8)
-        for i in range(8):
-            if crc & 0x8000:
-                crc = (crc << 1) ^ 0x1021
-            else:
-                crc <<= 1
-    return crc
+    return binascii.crc_hqx(bytes(data), 0)
+
+
+# A block of data padded with 0xFF to a size of 128 bytes, or 1024 bytes as in
+# XMODEM-1K, in a single buffer so that it is written to the port at once
+def xmodem_packet(pn, data, size):
+    SOH = 0x01
+    STX = 0x02
+    data = bytearray(data) + bytearray([0xFF]) * (size - len(data))
+    crc = calc_crc(data)
+    header = bytearray([STX if size == 1024 else SOH, pn, 0xFF - pn])
+    return bytes(header + data + bytearray([crc >> 8, crc & 0xFF]))
 
 
-def xmodem_send(serial, file, quiet=True):
-    SOH = bytes(bytearray([0x01]))
+def xmodem_send(serial, file, quiet=True, block_size=128):
     EOT = bytes(bytearray([0x04]))
     ACK = bytes(bytearray([0x06]))
     NAK = bytes(bytearray([0x15]))
     NCG = b'C'
-    DATA_SIZE = 128
+    MAX_RETRIES = 10
 
     t = 0
     while True:
@@ -131,48 +150,47 @@ def xmodem_send(serial, file, quiet=True):
             break
     pn = 1
     file.seek(0)
-    data = bytearray(file.read(DATA_SIZE))
-    tx_size = 0
-    while data:
-        for i in range(DATA_SIZE - len(data)):
-            data += bytes(bytearray([0xFF]))
-        crc = calc_crc(data)
-        MAX_RETRIES = 1
-        retries = 0
-        while True:
-            serial.write(SOH)
-            serial.write(bytes(bytearray([pn])))
-            serial.write(bytes(bytearray([0xFF - pn])))
-            serial.write(data)
-            serial.write(bytes(bytearray([(crc & 0xFF00) >> 8])))
-            serial.write(bytes(bytearray([crc & 0xFF])))
-            serial.flush()
-            answer = serial.read(1)
-            if answer == NAK:
-                if not quiet:
-                    print('!', end='')
-                    sys.stdout.flush()
-                retries += 1
-                if retries > MAX_RETRIES:
-                    return False
-                else:
-                    continue
-            if answer == ACK:
-                retries = 0
-                tx_size += DATA_SIZE
-                if not tx_size % (1024*10):
-                    print('.', end='')
-                    sys.stdout.flush()
-                break
-            # If got nothing, exit
+    image = file.read()
+    offset = 0
+    retries = 0
+    while offset < len(image):
+        # 1K blocks while they are mostly data, as 128 byte blocks pad less
+        size = 1024 if block_size == 1024 and \
+            len(image) - offset > 7 * 128 else 128
+        serial.write(xmodem_packet(pn, image[offset:offset + size], size))
+        serial.flush()
+        answer = serial.read(1)
+        if answer == ACK:
+            retries = 0
+            if offset // (1024*10) != (offset + size) // (1024*10):
+                print('.', end='')
+                sys.stdout.flush()
+            offset += size
+            pn = (pn + 1) % 256
+            continue
+        if size == 1024 and offset == 0:
+            # the bootloader does not take 1K blocks, resend in 128 bytes
+            if not quiet:
+                print('1K blocks not supported, using 128 byte blocks')
+            block_size = 128
+            # drop the stale answers to the 1K block and wait for the
+            # receiver to ask for the first block again
+            serial.reset_input_buffer()
+            for _ in range(10):
+                if serial.read(1) in (NAK, NCG):
+                    break
+            else:
+                return False
+            continue
+        if not quiet:
+            print('!' if answer == NAK else '$', end='')
+            sys.stdout.flush()
+        # resend the block, as a lost block or ACK is answered by a timeout
+        retries += 1
+        if retries > MAX_RETRIES:
             serial.write(EOT)
             serial.flush()
-            if not quiet:
-                print('$', end='')
-                sys.stdout.flush()
             return False
-        data = bytearray(file.read(DATA_SIZE))
-        pn = (pn + 1) % 256
     serial.write(EOT)
     serial.flush()
     answer = serial.read(1)
@@ -181,7 +199,90 @@ def xmodem_send(serial, file, quiet=True):
     return True
 
 
-def update_image(ser, command, filename):
+# CRC32 of every page of an image, the same as myriota_crc32 of the page with
+# an offset of 0
+def page_hashes(filename, page_size):
+    with open(filename, 'rb') as f:
+        image = f.read()
+    return [zlib.crc32(image[i:i + page_size]) & 0xFFFFFFFF
+            for i in range(0, len(image), page_size)]
+
+
+def manifest_path(device_id, command):
+    name = ''.join(c if c.isalnum() else '_' for c in device_id + '_' + command)
+    return os.path.join(MANIFEST_DIR, name + '.json')
+
+
+def load_manifest(device_id, command):
+    try:
+        with open(manifest_path(device_id, command)) as f:
+            return json.load(f)
+    except (IOError, ValueError):
+        return None
+
+
+def save_manifest(device_id, command, manifest):
+    try:
+        try:
+            os.makedirs(MANIFEST_DIR)
+        except OSError:
+            # may be made meanwhile by the worker of another port
+            if not os.path.isdir(MANIFEST_DIR):
+                raise
+        with open(manifest_path(device_id, command), 'w') as f:
+            json.dump(manifest, f)
+    except (IOError, OSError):
+        sys.stderr.write('failed to save the page hashes\n')
+
+
+def delete_manifest(device_id, command):
+    try:
+        os.remove(manifest_path(device_id, command))
+    except OSError:
+        pass
+
+
+def update_image_delta(ser, command, filename, block_size, page_size):
+    '''
+    Program an image unless the hashes of its pages match the image last
+    programmed into the device by the same command from this host. The
+    bootloader writes whole images, so an image with changed pages is
+    programmed in full.
+
+    The hashes are removed before programming and saved once it succeeds, and
+    every update without --delta removes them too, so a device is only skipped
+    if this host has programmed it since. The device cannot report the image it
+    runs, so one programmed by another host or tool is not detected.
+    '''
+    device_id = read_id(ser).strip()
+    if not device_id:
+        sys.stderr.write('failed to read the ID, programming in full\n')
+        return update_image(ser, command, filename, block_size)
+    try:
+        manifest = {'page_size': page_size,
+                    'pages': page_hashes(filename, page_size)}
+    except IOError:
+        sys.stderr.write('failed to open the file\n')
+        return False
+    old = load_manifest(device_id, command)
+    if old is not None and old.get('page_size') == page_size:
+        pages, old_pages = manifest['pages'], old.get('pages', [])
+        changed = sum(1 for i in range(len(pages))
+                      if i >= len(old_pages) or pages[i] != old_pages[i])
+        if changed == 0 and len(pages) == len(old_pages):
+            print('\n%s is unchanged on %s, skipping ' % (filename, device_id),
+                  end='')
+            return True
+        print('\n%d of %d pages of %s changed' % (changed, len(pages),
+                                                 filename), end='')
+    delete_manifest(device_id, command)
+    if not update_image(ser, command, filename, block_size):
+        return False
+    save_manifest(device_id, command, manifest)
+    return True
+
+
+def update_image(ser, command, filename, block_size=128):
     try:
         stream = open(filename, 'rb')
     except IOError:
@@ -200,7 +301,7 @@ def update_image(ser, command, filename):
         out += ser.readline()
         out += ser.readline()
         if b'Ready' in out:
-            if xmodem_send(ser, stream):
+            if xmodem_send(ser, stream, block_size=block_size):
                 stream.close()
                 return True
         retries -= 1
@@ -218,31 +319,130 @@ def jump_to_app(ser):
     ser.flush()
 
 
-def get_id(ser):
-    print('ID:',end='')
+def read_id(ser):
     ser.write(b'i')
     ser.flush()
     out = b''
     ser.readline()
     out += ser.readline()
-    print(out.decode('utf-8'))
+    return out.decode('utf-8')
 
-def get_regcode(ser):
-    print('Registration code:',end='')
+
+def read_regcode(ser):
     ser.write(b'g')
     ser.flush()
     out = b''
     ser.readline()
     out += ser.readline()
-    print(out.decode('utf-8'))
+    return out.decode('utf-8')
 
-def get_version(ser):
+
+def read_version(ser):
     ser.write(b'V')
     ser.flush()
     out = b''
     ser.readline()
     out += ser.readline()
-    print(out.decode('utf-8'))
+    return out.decode('utf-8')
+
+
+def get_id(ser):
+    print('ID:',end='')
+    print(read_id(ser))
+
+def get_regcode(ser):
+    print('Registration code:',end='')
+    print(read_regcode(ser))
+
+def get_version(ser):
+    print(read_version(ser))
+
+
+def run_updates(ser, update_commands, args):
+    for d in update_commands:
+        if args.delta_flag:
+            ok = update_image_delta(ser, d[0], d[1], args.block_size,
+                                    args.page_size)
+        else:
+            # the image recorded for --delta is about to be replaced
+            if os.path.isdir(MANIFEST_DIR):
+                device_id = read_id(ser).strip()
+                if device_id:
+                    delete_manifest(device_id, d[0])
+            ok = update_image(ser, d[0], d[1], args.block_size)
+        if not ok:
+            return False
+        print('done')
+    return True
+
+
+def update_device(port_name, update_commands, args, result):
+    '''
+    Worker for one port of a parallel update, filling in the result dict
+    '''
+    try:
+        ser = serial.Serial(
+            port=port_name,
+            baudrate=115200,
+            parity=serial.PARITY_NONE,
+            stopbits=serial.STOPBITS_ONE,
+            bytesize=serial.EIGHTBITS,
+            xonxoff=0,
+            rtscts=0,
+            timeout=0.5
+        )
+    except (OSError, serial.SerialException):
+        result['status'] = 'failed to open'
+        return
+    try:
+        if not capture_bootloader(ser):
+            result['status'] = 'no bootloader'
+            return
+        result['id'] = read_id(ser).strip()
+        result['regcode'] = read_regcode(ser).strip()
+        result['version'] = read_version(ser).strip()
+        if not run_updates(ser, update_commands, args):
+            result['status'] = 'update failed'
+            return
+        if args.start_flag:
+            jump_to_app(ser)
+        result['status'] = 'ok'
+    except (OSError, serial.SerialException):
+        result['status'] = 'port error'
+    finally:
+        ser.close()
+
+
+def update_all(update_commands, args):
+    '''
+    Update every attached device in parallel, one thread per port, and print
+    a summary. Returns True if all devices succeeded.
+    '''
+    port_names = find_serial_ports()
+    if not port_names:
+        sys.stderr.write('no devices found\n')
+        return False
+    print('Updating %d devices on %s' % (len(port_names),
+                                         ', '.join(port_names)))
+    results = [{'port': p, 'id': '', 'regcode': '', 'version': '',
+                'status': 'failed'} for p in port_names]
+    workers = [threading.Thread(target=update_device,
+                                args=(r['port'], update_commands, args, r))
+               for r in results]
+    for w in workers:
+        w.daemon = True
+        w.start()
+    for w in workers:
+        w.join()
+
+    print('\n%-16s %-20s %-16s %-16s %s'
+          % ('Port', 'ID', 'Registration code', 'Version', 'Result'))
+    for r in results:
+        print('%-16s %-20s %-16s %-16s %s' % (r['port'], r['id'], r['regcode'],
+                                               r['version'], r['status']))
+    failed = sum(1 for r in results if r['status'] != 'ok')
+    print('%d of %d devices succeeded' % (len(results) - failed, len(results)))
+    return failed == 0
 
 ser = None
 
@@ -279,7 +479,31 @@ def main():
     parser.add_argument('-v', '--version', dest='get_version_flag', action='store_true',
                         default=False,
                         help='get bootloader version (only support 0.9.0 or later)')
+    parser.add_argument('-k', '--1k', dest='block_size', action='store_const',
+                        const=1024, default=128,
+                        help='send XMODEM-1K blocks of 1024 bytes, falling back to 128 bytes if not supported')
+    parser.add_argument('-d', '--delta', dest='delta_flag', action='store_true',
+                        default=False,
+                        help='skip images whose page hashes match the last update of the device from this host. '
+                        'Trusts the hashes kept on this host, so an image programmed by another host or tool is not detected')
+    parser.add_argument('--page-size', dest='page_size', type=int, default=2048,
+                        help='flash page size in bytes for --delta')
+    parser.add_argument('-a', '--all', dest='all_flag', action='store_true',
+                        default=False,
+                        help='update all attached devices in parallel and report their ID, registration code and version')
     args = parser.parse_args()
+
+    update_commands = []
+    if args.system_image_name:
+        update_commands.append(['u', args.system_image_name])
+    if args.user_app_name:
+        update_commands.append(['s', args.user_app_name])
+    if args.raw_commands is not None:
+        update_commands += args.raw_commands
+
+    if args.all_flag:
+        sys.exit(0 if update_all(update_commands, args) else 1)
+
     if args.portname == 'None':
         parser.error("Please specify the serial port.")
     port_name = args.portname
@@ -290,7 +514,8 @@ def main():
     else:
         print('Using serial port', port_name)
         serial_port = open_serial_port(port_name)
-    capture_bootloader(serial_port)
+    if not capture_bootloader(serial_port):
+        sys.exit(1)
 
     if args.get_id_flag:
         get_id(serial_port)
@@ -304,23 +529,12 @@ def main():
         get_version(serial_port)
         sys.exit(0)
 
-    update_commands = []
-    if args.system_image_name:
-        update_commands.append(['u', args.system_image_name])
-    if args.user_app_name:
-        update_commands.append(['s', args.user_app_name])
-    if args.raw_commands is not None:
-        update_commands += args.raw_commands
-
     if not update_commands:
         parser.error("Please specify the files to program.")
 
-    for d in update_commands:
-        if update_image(serial_port, d[0], d[1]):
-            print('done')
-        else:
-            serial_port.close()
-            sys.exit(1)
+    if not run_updates(serial_port, update_commands, args):
+        serial_port.close()
+        sys.exit(1)
 
     if args.start_flag:
         print('Starting the application')